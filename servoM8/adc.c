@@ -32,6 +32,8 @@
 #include "config.h"
 #include "adc.h"
 #include "timer.h"
+#include "fifo.h"
+#include "pwm.h"
 
 //
 // ATtiny45/85
@@ -73,31 +75,441 @@
 //  ADC2 (PC2) - Position input
 //
 
+#if ADC_SCHEDULE
+
+//
+// ADC Channel Schedule
+//
+// Each sample period the timer starts a conversion of the position channel
+// so position sampling stays free of jitter.  The channels in the schedule
+// table below are then converted back to back in table order.  Each entry
+// gives the ADMUX value for the channel, a divisor to sample the channel
+// every Nth sample period (0 to only sample the channel on request), flags,
+// and where to save the sample and flag it as ready.  Additional channels
+// such as a temperature sensor or a second pot are added as rows in the
+// table with a new ADC_SCHEDULE_XXX index in adc.h.  All conversions due
+// in a sample period must complete before the next sample period starts.
+//
+
+// The position channel precedes the first schedule entry so incrementing
+// the channel from position selects the first entry.
+#define ADC_CHANNEL_POSITION    0xFF
+
+// ADMUX value selecting AVCC as voltage reference, right adjusted results
+// and the specified analog input.
+#define ADC_ADMUX(input)        ((0<<REFS1) | (1<<REFS0) | (0<<ADLAR) | (input))
+
+// Start the conversion from the next motor PWM timer/counter1 overflow.
+#define ADC_SCHEDULE_SYNC       0x01
+
+// Float the H-bridge and discard REG_BEMF_BLANKING conversions before
+// the sample.  The channel is only sampled while REG_BEMF_ENABLE is set.
+#define ADC_SCHEDULE_FLOAT      0x02
+
+// An entry in the ADC schedule table.
+typedef struct adc_schedule_entry
+{
+    uint8_t admux;
+    uint8_t divisor;
+    uint8_t flags;
+    volatile uint16_t *value;
+    volatile uint8_t *ready;
+} adc_schedule_entry;
+
+#else
+
 // Defines for the power and position channels.
 #define ADC_CHANNEL_POWER       0
 #define ADC_CHANNEL_POSITION    1
 #define ADC_CHANNEL_VOLTAGE     2
 
+#endif // ADC_SCHEDULE
+
 // The ADC clock prescaler of 64 is selected to yield a 125 KHz ADC clock
 // from an 8 MHz system clock.
 #define ADPS		((1<<ADPS2) | (1<<ADPS1) | (0<<ADPS0))
 
 // The timer clock prescaler of 1024 is selected to yield a 7.8125 KHz ADC clock
 // from an 8 MHz system clock.
+#if ADC_TIMER2
+#define CSPS		((1<<CS22) | (1<<CS21) | (1<<CS20))
+#else
 #define CSPS		((1<<CS02) | (0<<CS01) | (1<<CS00))
+#endif
 
 // Define the compare register value to generate a timer interrupt and initiate
 // an ADC sample every 9.987 milliseconds and yield a 100.1603 Hz sample rate.
 #define CRVALUE		78
 
+#if ADC_OVERSAMPLE_ENABLED
+
+// The conversions each sample period are the oversampled position burst and
+// one conversion of each of the other channels.  Back-EMF blanking
+// conversions are not counted.
+#if ADC_SCHEDULE
+#define ADC_PERIOD_CONVERSIONS	(ADC_OVERSAMPLE_COUNT + ADC_SCHEDULE_SIZE)
+#else
+#define ADC_PERIOD_CONVERSIONS	(ADC_OVERSAMPLE_COUNT + 2)
+#endif
+
+// A conversion takes 13 ADC clocks or 104 usec at the 125 KHz ADC clock.
+#define ADC_CONVERSION_USEC		104
+
+// The shortest supported sample period in milliseconds that the conversions
+// fit in.  A shorter period would start the next burst before the last one
+// is complete.
+#if (ADC_PERIOD_CONVERSIONS * ADC_CONVERSION_USEC) <= 1000
+#define ADC_MIN_SAMPLE_PERIOD	1
+#elif (ADC_PERIOD_CONVERSIONS * ADC_CONVERSION_USEC) <= 2000
+#define ADC_MIN_SAMPLE_PERIOD	2
+#elif (ADC_PERIOD_CONVERSIONS * ADC_CONVERSION_USEC) <= 5000
+#define ADC_MIN_SAMPLE_PERIOD	5
+#elif (ADC_PERIOD_CONVERSIONS * ADC_CONVERSION_USEC) <= 10000
+#define ADC_MIN_SAMPLE_PERIOD	10
+#else
+#  error "Configuration settings for ADC_OVERSAMPLE_BITS take longer than the 10 msec sample period."
+#endif
+
+#endif // ADC_OVERSAMPLE_ENABLED
+
+#if ADC_SAMPLE_PERIOD_ENABLED
+
+// The timer clock prescalers used for the selectable sample periods.  The
+// compare register values for each period are given in adc_sample_period_select().
+#if ADC_TIMER2
+#define CSPS_1024	((1<<CS22) | (1<<CS21) | (1<<CS20))
+#define CSPS_256	((1<<CS22) | (1<<CS21) | (0<<CS20))
+#define CSPS_64		((1<<CS22) | (0<<CS21) | (0<<CS20))
+#else
+#define CSPS_1024	((1<<CS02) | (0<<CS01) | (1<<CS00))
+#define CSPS_256	((1<<CS02) | (0<<CS01) | (0<<CS00))
+#define CSPS_64		((0<<CS02) | (1<<CS01) | (1<<CS00))
+#endif
+
+// The timer prescale and compare register value for the selected sample period.
+#define TIMER_CSPS		adc_csps
+#define TIMER_CRVALUE	adc_crvalue
+
+#else
+
+#define TIMER_CSPS		CSPS
+#define TIMER_CRVALUE	CRVALUE
+
+#endif // ADC_SAMPLE_PERIOD_ENABLED
+
 
 // Globals used to maintain ADC state and values.
 volatile uint8_t adc_channel;
 volatile uint8_t adc_power_ready;
 volatile uint16_t adc_power_value;
 volatile uint8_t adc_position_ready;
+#if ADC_TIMER2
+volatile uint8_t adc_latency_min;
+volatile uint8_t adc_latency_max;
+#endif
 volatile uint16_t adc_position_value;
+#if ADC_OVERSAMPLE_ENABLED
+volatile uint16_t adc_position_hires;
+static uint16_t adc_position_sum;
+static uint8_t adc_position_count;
+#endif
+#if ADC_MEDIAN_ENABLED
+volatile uint16_t adc_position_outliers;
+static uint16_t adc_median_ring[ADC_MEDIAN_SIZE];
+static uint8_t adc_median_index;
+static uint8_t adc_median_primed;
+#endif
+#if ADC_SCHEDULE
+volatile uint8_t adc_schedule_requests;
+volatile uint8_t adc_voltage_ready;
+volatile uint16_t adc_voltage_value;
+static uint8_t adc_schedule_countdown[ADC_SCHEDULE_SIZE];
+#if BEMF_ENABLED
+volatile uint8_t adc_bemf_ready;
+volatile uint16_t adc_bemf_value;
+static uint8_t adc_blanking;
+#endif
+
+// The ADC schedule table indexed by the ADC_SCHEDULE_XXX defines.
+static const adc_schedule_entry adc_schedule[ADC_SCHEDULE_SIZE] =
+{
+    // ADC_SCHEDULE_POWER - ADC0 (PC0) power input.
+#if ADC_POWER_SYNC_ENABLED && defined(__AVR_ATmega8__)
+    { ADC_ADMUX(0), ADC_POWER_DIVISOR, ADC_SCHEDULE_SYNC, &adc_power_value, &adc_power_ready },
+#else
+    { ADC_ADMUX(0), ADC_POWER_DIVISOR, 0, &adc_power_value, &adc_power_ready },
+#endif
+
+    // ADC_SCHEDULE_VOLTAGE - ADC1 (PC1) supply voltage input.
+    { ADC_ADMUX(1), ADC_VOLTAGE_DIVISOR, 0, &adc_voltage_value, &adc_voltage_ready },
+
+#if BEMF_ENABLED
+    // ADC_SCHEDULE_BEMF - Motor back-EMF input with the H-bridge floated.
+    { ADC_ADMUX(BEMF_ADC_CHANNEL), 1, ADC_SCHEDULE_FLOAT, &adc_bemf_value, &adc_bemf_ready },
+#endif
+};
+#else
 volatile uint8_t adc_voltage_needed;
+#endif
+
+#if ADC_HEALTH_ENABLED
+// Globals used to maintain the ADC pipeline health.
+static volatile uint8_t adc_position_sequence;
+static volatile uint8_t adc_power_sequence;
+static volatile uint16_t adc_position_overruns;
+static volatile uint16_t adc_power_overruns;
+static uint8_t adc_position_used;
+static uint8_t adc_worst_gap;
+#endif
+
+#if ADC_SAMPLE_PERIOD_ENABLED
+// Globals used to maintain the selected sample period.
+uint8_t adc_sample_period;
+uint8_t adc_sample_ticks;
+static uint8_t adc_sample_register;
+static uint8_t adc_csps;
+static volatile uint8_t adc_crvalue;
+static volatile uint8_t adc_tick_count;
+
+
+static void adc_sample_period_select(void)
+// Select the sample period timer settings from the sample period register.
+// Unsupported periods are rounded down to the next supported period.
+// Periods too short for the oversampling burst are rounded up to the
+// shortest period the burst fits in.
+{
+    uint8_t period;
+
+    // Get the requested sample period in milliseconds.
+    adc_sample_register = banks_read_byte(BANK_CONFIG, REG_SAMPLE_PERIOD);
+    period = adc_sample_register;
+
+#if ADC_OVERSAMPLE_ENABLED
+    // Leave time for the oversampling burst and the other channels.
+    if (period < ADC_MIN_SAMPLE_PERIOD) period = ADC_MIN_SAMPLE_PERIOD;
+#endif
+
+    if (period >= 10)
+    {
+        // 128 usec timer clock, 78 counts for a 9.984 msec period.
+        adc_sample_period = 10;
+        adc_csps = CSPS_1024;
+        adc_crvalue = 78;
+    }
+    else if (period >= 5)
+    {
+        // 32 usec timer clock, 156 counts for a 4.992 msec period.
+        adc_sample_period = 5;
+        adc_csps = CSPS_256;
+        adc_crvalue = 156;
+    }
+    else if (period >= 2)
+    {
+        // 8 usec timer clock, 250 counts for a 2.000 msec period.
+        adc_sample_period = 2;
+        adc_csps = CSPS_64;
+        adc_crvalue = 250;
+    }
+    else
+    {
+        // 8 usec timer clock, 125 counts for a 1.000 msec period.
+        adc_sample_period = 1;
+        adc_csps = CSPS_64;
+        adc_crvalue = 125;
+    }
+
+    // The timer register is kept in 10 millisecond ticks regardless
+    // of the sample period.
+    adc_sample_ticks = 10 / adc_sample_period;
+    adc_tick_count = adc_sample_ticks;
+}
+
+
+void adc_registers_defaults(void)
+// Initialize the ADC related register values.
+{
+    // Default sample period.
+    banks_write_byte(BANK_CONFIG, REG_SAMPLE_PERIOD, DEFAULT_SAMPLE_PERIOD);
+}
+
+
+void adc_sample_period_update(void)
+// Reprogram the sample timer if the sample period register has changed.
+{
+    // Has the sample period register changed?
+    if (banks_read_byte(BANK_CONFIG, REG_SAMPLE_PERIOD) == adc_sample_register) return;
+
+    // Disable interrupts while the timer is reprogrammed.
+    cli();
+
+    // Select the new sample period.
+    adc_sample_period_select();
+
+#if defined(__AVR_ATtiny45__) || defined(__AVR_ATtiny85__) || defined(__AVR_ATmega88__) || defined(__AVR_ATmega168__)
+    // Update the timer clock prescale and compare match A value.  The timer
+    // clears on the count after the compare match so the period is the
+    // compare value plus one count.
+    TCCR0B = (TCCR0B & ~((1<<CS02) | (1<<CS01) | (1<<CS00))) | TIMER_CSPS;
+    OCR0A = TIMER_CRVALUE - 1;
+#endif
+
+#if defined(__AVR_ATmega8__)
+#if ADC_TIMER2
+    // Update the timer clock prescale and compare value and restart the count.
+    TCCR2 = (1<<WGM21) | TIMER_CSPS;
+    OCR2 = TIMER_CRVALUE - 1;
+    TCNT2 = 0;
+
+    // The latency is measured in the new timer counts.
+    adc_latency_min = 0xFF;
+    adc_latency_max = 0;
+#else
+    // Update the timer clock prescale.  The new counter value is
+    // loaded on the next timer overflow.
+    TCCR0 = TIMER_CSPS;
+#endif
+#endif
+
+    // Restore interrupts.
+    sei();
+}
+
+#endif // ADC_SAMPLE_PERIOD_ENABLED
+
+
+#if ADC_MEDIAN_ENABLED
+
+static inline uint16_t adc_median_filter(uint16_t new_value, uint8_t shift)
+// Add the new position value to the ring of recent values and return
+// their median.  The value is in 10-bit counts scaled up by shift bits.
+// The cost is bounded by the fixed number of compares needed to sort a
+// copy of the ring.
+{
+    uint8_t i;
+    uint16_t median;
+
+    // Fill the ring with the first value so the filter starts settled.
+    if (!adc_median_primed)
+    {
+        for (i = 0; i < ADC_MEDIAN_SIZE; ++i) adc_median_ring[i] = new_value;
+        adc_median_primed = 1;
+    }
+
+    // Replace the oldest value in the ring.
+    adc_median_ring[adc_median_index] = new_value;
+    if (++adc_median_index >= ADC_MEDIAN_SIZE) adc_median_index = 0;
+
+#if ADC_MEDIAN_SIZE == 3
+    // Select the middle of three values directly.
+    {
+        uint16_t a = adc_median_ring[0];
+        uint16_t b = adc_median_ring[1];
+        uint16_t c = adc_median_ring[2];
+
+        if (a > b) { uint16_t t = a; a = b; b = t; }
+        median = (b < c) ? b : ((a > c) ? a : c);
+    }
+#else
+    // Insertion sort a copy of the ring.
+    uint8_t j;
+    uint16_t sorted[ADC_MEDIAN_SIZE];
+
+    for (i = 0; i < ADC_MEDIAN_SIZE; ++i)
+    {
+        uint16_t value = adc_median_ring[i];
+
+        for (j = i; (j > 0) && (sorted[j - 1] > value); --j) sorted[j] = sorted[j - 1];
+
+        sorted[j] = value;
+    }
+
+    median = sorted[ADC_MEDIAN_SIZE / 2];
+#endif
+
+    // Count the new value as an outlier if it is far from the median.
+    if (((new_value > median) ? (new_value - median) : (median - new_value)) > ((uint16_t) ADC_MEDIAN_THRESHOLD << shift))
+    {
+        // Saturate rather than wrap the count.
+        if (adc_position_outliers != 0xFFFF) ++adc_position_outliers;
+    }
+
+    return median;
+}
+
+#endif // ADC_MEDIAN_ENABLED
+
+
+#if ADC_HEALTH_ENABLED
+
+void adc_health_update(void)
+// Update the ADC pipeline health registers after a position sample is used.
+// The gap is the number of position samples since the last one used and
+// is one when the main loop keeps up with the sample rate.
+{
+    uint8_t sequence = adc_position_sequence;
+    uint8_t gap = sequence - adc_position_used;
+
+    // Remember the sample used and latch the worst gap.
+    adc_position_used = sequence;
+    if (gap > adc_worst_gap) adc_worst_gap = gap;
+
+    // Report the sequence numbers, overrun counts and worst gap.
+    banks_write_byte(BANK_STATUS, REG_POSITION_SEQUENCE, sequence);
+    banks_write_byte(BANK_STATUS, REG_POWER_SEQUENCE, adc_power_sequence);
+    banks_write_word(BANK_STATUS, REG_POSITION_OVERRUNS_HI, REG_POSITION_OVERRUNS_LO, adc_position_overruns);
+    banks_write_word(BANK_STATUS, REG_POWER_OVERRUNS_HI, REG_POWER_OVERRUNS_LO, adc_power_overruns);
+    banks_write_byte(BANK_STATUS, REG_WORST_GAP, adc_worst_gap);
+}
+
+
+void adc_health_reset(void)
+// Reset the ADC pipeline health counters.  The sequence numbers keep
+// running so the next gap is measured from the last sample used.
+{
+    // Disable interrupts while the counters are reset.
+    cli();
+
+    adc_position_overruns = 0;
+    adc_power_overruns = 0;
+    adc_worst_gap = 0;
+#if ADC_TIMER2
+    adc_latency_min = 0xFF;
+    adc_latency_max = 0;
+#endif
+
+    // Restore interrupts.
+    sei();
+}
+
+
+static inline void adc_position_health(void)
+// Count a new position sample and an overrun if the last one was not used.
+{
+    ++adc_position_sequence;
+    if (adc_position_ready && (adc_position_overruns != 0xFFFF)) ++adc_position_overruns;
+}
+
+
+static inline void adc_power_health(void)
+// Count a new power sample and an overrun if the last one was not used.
+{
+    ++adc_power_sequence;
+    if (adc_power_ready && (adc_power_overruns != 0xFFFF)) ++adc_power_overruns;
+}
+
+#endif // ADC_HEALTH_ENABLED
+
+
+static inline void adc_timer_tick(void)
+// Increment the timer every 10 milliseconds worth of position samples.
+{
+#if ADC_SAMPLE_PERIOD_ENABLED
+    if (--adc_tick_count) return;
+    adc_tick_count = adc_sample_ticks;
+#endif
+
+    timer_increment();
+}
 
 
 void adc_init(void)
@@ -106,12 +518,58 @@ void adc_init(void)
     // Read from position first.
     adc_channel = ADC_CHANNEL_POSITION;
 
+#if ADC_SAMPLE_PERIOD_ENABLED
+    // Select the sample period.
+    adc_sample_period_select();
+#endif
+
     // Initialize flags and values.
     adc_power_ready = 0;
     adc_power_value = 0;
     adc_position_ready = 0;
     adc_position_value = 0;
+#if ADC_TIMER2
+    adc_latency_min = 0xFF;
+    adc_latency_max = 0;
+#endif
+#if ADC_OVERSAMPLE_ENABLED
+    adc_position_hires = 0;
+    adc_position_sum = 0;
+    adc_position_count = 0;
+#endif
+#if ADC_MEDIAN_ENABLED
+    adc_position_outliers = 0;
+    adc_median_index = 0;
+    adc_median_primed = 0;
+#endif
+#if ADC_SCHEDULE
+    {
+        uint8_t i;
+
+        // Sample each scheduled channel in the first sample period.
+        for (i = 0; i < ADC_SCHEDULE_SIZE; ++i) adc_schedule_countdown[i] = 1;
+    }
+
+    // Request the supply voltage.
+    adc_schedule_requests = (1<<ADC_SCHEDULE_VOLTAGE);
+    adc_voltage_ready = 0;
+    adc_voltage_value = 0;
+#if BEMF_ENABLED
+    adc_bemf_ready = 0;
+    adc_bemf_value = 0;
+    adc_blanking = 0;
+#endif
+#else
     adc_voltage_needed = 1;
+#endif
+#if ADC_HEALTH_ENABLED
+    adc_position_sequence = 0;
+    adc_power_sequence = 0;
+    adc_position_overruns = 0;
+    adc_power_overruns = 0;
+    adc_position_used = 0;
+    adc_worst_gap = 0;
+#endif
 
     //
     // Initialize ADC registers to yield a 125KHz clock.
@@ -146,6 +604,11 @@ void adc_init(void)
     // Make sure ports PC0 (ADC0), PC1 (ADC1) and PC2 (ADC2) are set low.
     PORTC &= ~((1<<PC2) | (1<<PC1) | (1<<PC0));
 
+#if ADC_SCHEDULE && BEMF_ENABLED
+    // Make sure the back-EMF input pin pull-up is disabled.
+    PORTC &= ~(1<<BEMF_ADC_CHANNEL);
+#endif
+
     // Set the ADC multiplexer selection register.
     ADMUX = (0<<REFS1) | (1<<REFS0) |                       // Select AVCC as voltage reference.
             (0<<MUX3) | (0<<MUX2) | (1<<MUX1) | (0<<MUX0) | // Select ADC2 (PC2) as analog input.
@@ -160,8 +623,10 @@ void adc_init(void)
              (1<<ADIE) |                                    // Activate ADC conversion complete interrupt.
              ADPS;											// Prescale -- see above.
 
+#if !ADC_TIMER2
     // Reset the counter value to initiate another ADC sample at the specified time.
-    TCNT0 = 256 - CRVALUE;
+    TCNT0 = 256 - TIMER_CRVALUE;
+#endif
 #endif // __AVR_ATmega8____
 
 #if defined(__AVR_ATmega88__) || defined(__AVR_ATmega168__)
@@ -196,26 +661,46 @@ void adc_init(void)
     // Set timer/counter0 control register B.
     TCCR0B = (0<<FOC0A) | (0<<FOC0B) |                      // No force output compare A or B.
              (0<<WGM02) |                                   // Mode 2 - clear timer on compare match.
-             CSPS;											// Timer clock prescale -- see above.
+             TIMER_CSPS;											// Timer clock prescale -- see above.
 
     // Set the timer/counter0 interrupt masks.
     TIMSK = (1<<OCIE0A) |                                   // Interrupt on compare match A.
             (0<<OCIE0B) |                                   // No interrupt on compare match B.
             (0<<TOIE0);                                     // No interrupt on overflow.
 
-    // Set the compare match A value which initiates an ADC sample.
-    OCR0A = CRVALUE;
+    // Set the compare match A value which initiates an ADC sample.  The
+    // timer clears on the count after the compare match so the period is
+    // the compare value plus one count.
+    OCR0A = TIMER_CRVALUE - 1;
 #endif // __AVR_ATtiny45__ || __AVR_ATtiny85__
 
 #if defined(__AVR_ATmega8__)
+#if ADC_TIMER2
+    // Reset the counter and set the compare value which initiates an ADC sample.
+    TCNT2 = 0;
+    OCR2 = TIMER_CRVALUE - 1;
+
+    // Set timer/counter2 control register.
+    TCCR2 = (0<<FOC2) |                                     // No force output compare.
+            (0<<WGM20) | (1<<WGM21) |                       // Clear timer on compare match.
+            (0<<COM21) | (0<<COM20) |                       // Disconnect OC2.
+            TIMER_CSPS;                                     // Timer clock prescale -- see above.
+
+    // Clear any pending interrupt.
+    TIFR = (1<<OCF2);
+
+    // Set the timer/counter2 interrupt masks.
+    TIMSK |= (1<<OCIE2);                                    // Interrupt on compare match.
+#else
     // Set timer/counter0 control register.
-	TCCR0 = CSPS;											// Timer clock prescale -- see above.
+	TCCR0 = TIMER_CSPS;											// Timer clock prescale -- see above.
 
     // Clear any pending interrupt.
     TIFR |= (1<<TOV0);                                      // Interrupt on overflow.
 
     // Set the timer/counter0 interrupt masks.
     TIMSK |= (1<<TOIE0);                                    // Interrupt on overflow.
+#endif
 #endif // __AVR_ATmega8____
 
 #if defined(__AVR_ATmega88__) || defined(__AVR_ATmega168__)
@@ -227,15 +712,17 @@ void adc_init(void)
     // Set timer/counter0 control register B.
     TCCR0B = (0<<FOC0A) | (0<<FOC0B) |                      // No force output compare A or B.
              (0<<WGM02) |                                   // Mode 2 - clear timer on compare match.
-             CSPS;											// Timer clock prescale -- see above.
+             TIMER_CSPS;											// Timer clock prescale -- see above.
 
     // Set the timer/counter0 interrupt masks.
     TIMSK0 = (1<<OCIE0A) |                                  // Interrupt on compare match A.
              (0<<OCIE0B) |                                  // No interrupt on compare match B.
              (0<<TOIE0);                                    // No interrupt on overflow.
 
-    // Set the compare match A value which initiates an ADC sample.
-    OCR0A = CRVALUE;
+    // Set the compare match A value which initiates an ADC sample.  The
+    // timer clears on the count after the compare match so the period is
+    // the compare value plus one count.
+    OCR0A = TIMER_CRVALUE - 1;
 #endif // __AVR_ATmega88__ || __AVR_ATmega168__
 }
 
@@ -246,12 +733,41 @@ SIGNAL(SIG_OUTPUT_COMPARE0A)
 // Handles timer/counter0 compare match A.
 {
     // Increment the timer when positions are being sampled.
-    if (adc_channel == ADC_CHANNEL_POSITION) timer_increment();
+    if (adc_channel == ADC_CHANNEL_POSITION) adc_timer_tick();
 }
 
 #endif // __AVR_ATtiny45__ || __AVR_ATtiny85__ || __AVR_ATmega88__ || __AVR_ATmega168__
 
-#if defined(__AVR_ATmega8__)
+#if defined(__AVR_ATmega8__) && ADC_TIMER2
+
+SIGNAL(TIMER2_COMP_vect)
+// Handles timer/counter2 compare match.  The timer clears itself on the
+// compare match so the sample period is exact and only the latency of this
+// interrupt varies.  The ADC sample is initiated first to keep the latency
+// as short as possible and assumes that the ADC sample will complete before
+// the next compare match.
+{
+    uint8_t latency;
+
+    // Initiate an ADC sample.
+    ADCSRA = (1<<ADEN) |                                    // Enable ADC.
+             (1<<ADSC) |                                    // Start the first conversion.
+             (0<<ADFR) |                                    // Free running disabled.
+             (1<<ADIF) |                                    // Clear any pending interrupt.
+             (1<<ADIE) |                                    // Activate ADC conversion complete interrupt.
+             ADPS;											// Prescale -- see above.
+
+    // The counter has counted up from zero since the compare match so it
+    // gives the latency of the ADC start in timer counts.
+    latency = TCNT2;
+    if (latency < adc_latency_min) adc_latency_min = latency;
+    if (latency > adc_latency_max) adc_latency_max = latency;
+
+    // Increment the timer when positions are being sampled.
+    if (adc_channel == ADC_CHANNEL_POSITION) adc_timer_tick();
+}
+
+#elif defined(__AVR_ATmega8__)
 
 SIGNAL(TIMER0_OVF_vect)
 // Handles timer/counter0 overflow.  This interrupts initiates the next
@@ -259,7 +775,7 @@ SIGNAL(TIMER0_OVF_vect)
 // next timer overflow interrupt.
 {
     // Increment the timer when positions are being sampled.
-    if (adc_channel == ADC_CHANNEL_POSITION) timer_increment();
+    if (adc_channel == ADC_CHANNEL_POSITION) adc_timer_tick();
 
     // Initiate an ADC sample.
     ADCSRA = (1<<ADEN) |                                    // Enable ADC.
@@ -270,11 +786,131 @@ SIGNAL(TIMER0_OVF_vect)
              ADPS;											// Prescale -- see above.
 
     // Reset the counter value to initiate another ADC sample at the specified time.
-    TCNT0 = 256 - CRVALUE;
+    TCNT0 = 256 - TIMER_CRVALUE;
 }
 
 #endif // __AVR_ATmega8__
 
+#if ADC_POWER_SYNC_ENABLED && defined(__AVR_ATmega8__)
+
+// Set while a power conversion waits for the timer/counter1 overflow.
+volatile uint8_t adc_power_sync_pending;
+
+void adc_power_sync_overflow(void)
+// Start the power conversion waiting for the timer/counter1 overflow, if any.
+// Called from the timer/counter1 overflow interrupt.
+{
+    if (adc_power_sync_pending)
+    {
+        adc_power_sync_pending = 0;
+
+        // Start the ADC of the power channel now.
+        ADCSRA |= (1<<ADSC);
+    }
+}
+
+#if !PWM_DEADTIME_ENABLED
+
+ISR(TIMER1_OVF_vect)
+// Handles timer/counter1 overflow.  Timer/counter1 generates the motor PWM
+// in phase and frequency correct mode with non-inverted outputs.  The outputs
+// are high while the counter is below the compare value so the on time is
+// centered on the counter reaching bottom, which is when this interrupt
+// occurs.  Sampling the motor current here, rather than at an arbitrary
+// point in the PWM period, gives the average current during the on time.
+{
+    // Only one power sample is needed each sample period.
+    TIMSK &= ~(1<<TOIE1);
+
+    // Start the ADC of the power channel now.
+    adc_power_sync_overflow();
+}
+
+#endif // !PWM_DEADTIME_ENABLED
+
+#endif // ADC_POWER_SYNC_ENABLED && __AVR_ATmega8__
+
+#if ADC_SCHEDULE
+
+static inline void adc_schedule_next(void)
+// Start the conversion of the next scheduled channel due in this sample
+// period.  Once all due channels are converted switch back to position
+// to wait for the next sample period.
+{
+    while (++adc_channel < ADC_SCHEDULE_SIZE)
+    {
+        uint8_t due = 0;
+        const adc_schedule_entry *entry = &adc_schedule[adc_channel];
+
+        // Is the channel due at its own rate?
+        if (entry->divisor && (--adc_schedule_countdown[adc_channel] == 0))
+        {
+            adc_schedule_countdown[adc_channel] = entry->divisor;
+            due = 1;
+        }
+
+        // Has the channel been requested?
+        if (adc_schedule_requests & (1 << adc_channel))
+        {
+            adc_schedule_requests &= ~(1 << adc_channel);
+            due = 1;
+        }
+
+#if BEMF_ENABLED
+        // Is the channel sampled with the H-bridge floated?
+        if (entry->flags & ADC_SCHEDULE_FLOAT)
+        {
+            // Only float the H-bridge when the back-EMF is enabled.
+            if (!banks_read_byte(BANK_CONFIG, REG_BEMF_ENABLE)) due = 0;
+
+            if (due)
+            {
+                // Float the H-bridge and start the blanking window.
+                pwm_float();
+                adc_blanking = banks_read_byte(BANK_CONFIG, REG_BEMF_BLANKING);
+            }
+        }
+#endif
+
+        if (due)
+        {
+            // Set the ADC multiplexer selection register.
+            ADMUX = entry->admux;
+
+#if ADC_POWER_SYNC_ENABLED && defined(__AVR_ATmega8__)
+            if (entry->flags & ADC_SCHEDULE_SYNC)
+            {
+                // Start the conversion from the next timer/counter1
+                // overflow which is the middle of the PWM on time.
+                adc_power_sync_pending = 1;
+                TIFR = (1<<TOV1);
+                TIMSK |= (1<<TOIE1);
+
+                return;
+            }
+#endif
+
+            // Start the conversion now.
+            ADCSRA |= (1<<ADSC);
+
+            return;
+        }
+    }
+
+#if FIFO_ENABLED
+    // Record the position and power of this sample period.
+    fifo_push(adc_position_value, adc_power_value);
+#endif
+
+    // Switch to position for the next reading.
+    adc_channel = ADC_CHANNEL_POSITION;
+
+    // Set the ADC multiplexer selection register to ADC2 (PC2).
+    ADMUX = ADC_ADMUX(2);
+}
+
+#endif // ADC_SCHEDULE
+
 ISR(ADC_vect)
 // Handles ADC interrupt.
 {
@@ -287,12 +923,53 @@ ISR(ADC_vect)
 
         case ADC_CHANNEL_POSITION:
 
+#if ADC_OVERSAMPLE_ENABLED
+            // Accumulate the position samples.
+            adc_position_sum += new_value;
+
+            // Are more position samples needed?
+            if (++adc_position_count < ADC_OVERSAMPLE_COUNT)
+            {
+                // Yes. Start the ADC of the position channel again now.
+                ADCSRA |= (1<<ADSC);
+
+                break;
+            }
+
+            // Decimate the accumulated samples to the high resolution position
+            // and keep the 10-bit position value for compatibility.
+            adc_position_hires = adc_position_sum >> ADC_OVERSAMPLE_BITS;
+
+#if ADC_MEDIAN_ENABLED
+            // Reject spikes from the high resolution position.
+            adc_position_hires = adc_median_filter(adc_position_hires, ADC_OVERSAMPLE_BITS);
+#endif
+
+            new_value = adc_position_hires >> ADC_OVERSAMPLE_BITS;
+
+            // Reset the accumulator.
+            adc_position_sum = 0;
+            adc_position_count = 0;
+#elif ADC_MEDIAN_ENABLED
+            // Reject spikes from the position.
+            new_value = adc_median_filter(new_value, 0);
+#endif
+
+#if ADC_HEALTH_ENABLED
+            // Count the position sample and any overrun.
+            adc_position_health();
+#endif
+
             // Save the new position value.
             adc_position_value = new_value;
 
             // Flag the position value as ready.
             adc_position_ready = 1;
 
+#if ADC_SCHEDULE
+            // Start the scheduled channels.
+            adc_schedule_next();
+#else
             // Switch to power for the next reading.
             adc_channel = ADC_CHANNEL_POWER;
 
@@ -312,21 +989,78 @@ ISR(ADC_vect)
                     (0<<MUX3) | (0<<MUX2) | (0<<MUX1) | (0<<MUX0) | // Select ADC0 (PC0) as analog input.
                     (0<<ADLAR);                                     // Keep high bits right adjusted.
 
+#if ADC_POWER_SYNC_ENABLED && defined(__AVR_ATmega8__)
+            // Start the ADC of the power channel from the next timer/counter1
+            // overflow which is the middle of the PWM on time.
+            adc_power_sync_pending = 1;
+            TIFR = (1<<TOV1);
+            TIMSK |= (1<<TOIE1);
+#else
             // Start the ADC of the power channel now
             ADCSRA |= (1<<ADSC);
 #endif
+#endif
+#endif // ADC_SCHEDULE
 
             break;
 
+#if ADC_SCHEDULE
+        default:
+
+#if BEMF_ENABLED
+            // Is the channel sampled with the H-bridge floated?
+            if (adc_schedule[adc_channel].flags & ADC_SCHEDULE_FLOAT)
+            {
+                // Discard the conversions in the blanking window.
+                if (adc_blanking)
+                {
+                    --adc_blanking;
+
+                    // Start the ADC of the channel again now.
+                    ADCSRA |= (1<<ADSC);
+
+                    break;
+                }
+
+                // Drive the H-bridge again.
+                pwm_drive();
+            }
+#endif
+
+#if ADC_HEALTH_ENABLED
+            // Count the power sample and any overrun.
+            if (adc_channel == ADC_SCHEDULE_POWER) adc_power_health();
+#endif
+
+            // Save the value of the scheduled channel and flag it as ready.
+            *adc_schedule[adc_channel].value = new_value;
+            *adc_schedule[adc_channel].ready = 1;
+
+            // Start the next scheduled channel.
+            adc_schedule_next();
+
+            break;
+#else
+
 
         case ADC_CHANNEL_POWER:
 
+#if ADC_HEALTH_ENABLED
+            // Count the power sample and any overrun.
+            adc_power_health();
+#endif
+
             // Save the new power value.
             adc_power_value = new_value;
 
             // Flag the power value as ready.
             adc_power_ready = 1;
 
+#if FIFO_ENABLED
+            // Record the position and power of this sample period.
+            fifo_push(adc_position_value, new_value);
+#endif
+
 
 #if defined(__AVR_ATtiny45__) || defined(__AVR_ATtiny85__)
             // Switch to position for the next reading.
@@ -387,6 +1121,7 @@ ISR(ADC_vect)
                     (0<<ADLAR);                                     // Keep high bits right adjusted.
             break;
 #endif
+#endif // ADC_SCHEDULE
             
 
     }
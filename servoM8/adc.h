@@ -27,15 +27,88 @@
 #ifndef _OS_ADC_H_
 #define _OS_ADC_H_ 1
 
+// The table driven ADC channel scheduler is only used on the ATmega MCUs.
+#if ADC_SCHEDULE_ENABLED && !defined(__AVR_ATtiny45__) && !defined(__AVR_ATtiny85__)
+#define ADC_SCHEDULE            1
+#else
+#define ADC_SCHEDULE            0
+#endif
+
+// The timer/counter2 sample timebase is only used on the ATmega8.
+#if ADC_TIMER2_ENABLED && defined(__AVR_ATmega8__)
+#define ADC_TIMER2              1
+#else
+#define ADC_TIMER2              0
+#endif
+
+// Indices of the channels sampled after the position in the ADC schedule.
+#define ADC_SCHEDULE_POWER      0
+#define ADC_SCHEDULE_VOLTAGE    1
+#if BEMF_ENABLED
+#define ADC_SCHEDULE_BEMF       2
+#define ADC_SCHEDULE_SIZE       3
+#else
+#define ADC_SCHEDULE_SIZE       2
+#endif
+
 // Initialize ADC conversion.
 void adc_init(void);
 
+#if ADC_HEALTH_ENABLED
+// Update the ADC pipeline health registers after a position sample is used.
+void adc_health_update(void);
+
+// Reset the ADC pipeline health counters.
+void adc_health_reset(void);
+#endif
+
+#if ADC_SAMPLE_PERIOD_ENABLED
+// Initialize the ADC related register values.
+void adc_registers_defaults(void);
+
+// Reprogram the sample timer if the sample period register has changed.
+void adc_sample_period_update(void);
+
+// Declare externally so in-lines work.
+extern uint8_t adc_sample_period;
+extern uint8_t adc_sample_ticks;
+#endif
+
 // Declare externally so in-lines work.
 extern volatile uint8_t adc_power_ready;
 extern volatile uint16_t adc_power_value;
 extern volatile uint8_t adc_position_ready;
+#if ADC_TIMER2
+extern volatile uint8_t adc_latency_min;
+extern volatile uint8_t adc_latency_max;
+#endif
 extern volatile uint16_t adc_position_value;
+#if ADC_OVERSAMPLE_ENABLED
+extern volatile uint16_t adc_position_hires;
+#endif
+#if ADC_MEDIAN_ENABLED
+extern volatile uint16_t adc_position_outliers;
+#endif
+
+// The position is oversampled by 4^N conversions and decimated to
+// 10+N bits of resolution.
+#if ADC_OVERSAMPLE_ENABLED
+#define ADC_POSITION_SHIFT      ADC_OVERSAMPLE_BITS
+#define ADC_OVERSAMPLE_COUNT    (1 << (2 * ADC_OVERSAMPLE_BITS))
+#else
+#define ADC_POSITION_SHIFT      0
+#endif
+#if ADC_SCHEDULE
+extern volatile uint8_t adc_schedule_requests;
+extern volatile uint8_t adc_voltage_ready;
+extern volatile uint16_t adc_voltage_value;
+#if BEMF_ENABLED
+extern volatile uint8_t adc_bemf_ready;
+extern volatile uint16_t adc_bemf_value;
+#endif
+#else
 extern volatile uint8_t adc_voltage_needed;
+#endif
 
 
 // In-lines for fast access to power flags and values.
@@ -75,6 +148,52 @@ inline static uint16_t adc_get_position_value(void)
     return adc_position_value;
 }
 
+inline static uint16_t adc_get_position_hires(void)
+// Return the high resolution position value with ADC_POSITION_SHIFT
+// more bits than the 10-bit position value.  It is updated along with
+// the position value.
+{
+#if ADC_OVERSAMPLE_ENABLED
+    return adc_position_hires;
+#else
+    return adc_position_value;
+#endif
+}
+
+#if ADC_MEDIAN_ENABLED
+inline static uint16_t adc_get_position_outliers(void)
+// Return the count of position samples rejected by the median prefilter.
+{
+    return adc_position_outliers;
+}
+#endif
+
+#if ADC_POWER_SYNC_ENABLED && defined(__AVR_ATmega8__)
+extern volatile uint8_t adc_power_sync_pending;
+
+// Start the power conversion waiting for the timer/counter1 overflow, if any.
+// Called from the timer/counter1 overflow interrupt.
+void adc_power_sync_overflow(void);
+#endif
+
+#if ADC_TIMER2
+inline static uint8_t adc_get_sample_latency(void)
+// Return the worst latency from the timer/counter2 compare match to the
+// start of a position conversion in timer counts.
+{
+    return adc_latency_max;
+}
+
+inline static uint8_t adc_get_sample_jitter(void)
+// Return the spread between the best and worst latency in timer counts.
+{
+    // No spread until a latency has been measured.
+    if (adc_latency_max < adc_latency_min) return 0;
+
+    return adc_latency_max - adc_latency_min;
+}
+#endif
+
 inline static uint8_t adc_position_value_is_ready(void)
 // Return the ADC position value ready flag.
 {
@@ -91,7 +210,71 @@ inline static void adc_position_value_clear_ready(void)
 inline static void adc_read_voltage(void) 
 // Set a flag to start a adc on supply voltage channel.
 {
+#if ADC_SCHEDULE
+    adc_schedule_requests |= (1<<ADC_SCHEDULE_VOLTAGE);
+#else
     adc_voltage_needed = 1;
+#endif
+}
+
+#if ADC_SCHEDULE
+inline static uint16_t adc_get_voltage_value(void)
+// Return the 16-bit ADC supply voltage value.
+{
+    // Clear the ready ADC value ready flag.
+    adc_voltage_ready = 0;
+
+    // Return the value.
+    return adc_voltage_value;
+}
+
+inline static uint8_t adc_voltage_value_is_ready(void)
+// Return the ADC supply voltage value ready flag.
+{
+    // Return the value ready flag.
+    return adc_voltage_ready;
+}
+#endif
+
+#if ADC_SCHEDULE && BEMF_ENABLED
+inline static uint16_t adc_get_bemf_value(void)
+// Return the 16-bit ADC back-EMF value.
+{
+    // Clear the ready ADC value ready flag.
+    adc_bemf_ready = 0;
+
+    // Return the value.
+    return adc_bemf_value;
+}
+
+inline static uint8_t adc_bemf_value_is_ready(void)
+// Return the ADC back-EMF value ready flag.
+{
+    // Return the value ready flag.
+    return adc_bemf_ready;
+}
+#endif
+
+// In-lines for fast access to the sample period.
+
+inline static uint8_t adc_get_sample_period(void)
+// Return the sample period in milliseconds.
+{
+#if ADC_SAMPLE_PERIOD_ENABLED
+    return adc_sample_period;
+#else
+    return 10;
+#endif
+}
+
+inline static uint8_t adc_get_sample_ticks(void)
+// Return the number of samples in each 10 millisecond timer tick.
+{
+#if ADC_SAMPLE_PERIOD_ENABLED
+    return adc_sample_ticks;
+#else
+    return 1;
+#endif
 }
 
 #endif // _OS_ADC_H_
@@ -0,0 +1,314 @@
+/*
+    Copyright (c) 2006 Michael P. Thompson <mpthompson@gmail.com>
+
+    Permission is hereby granted, free of charge, to any person 
+    obtaining a copy of this software and associated documentation 
+    files (the "Software"), to deal in the Software without 
+    restriction, including without limitation the rights to use, copy, 
+    modify, merge, publish, distribute, sublicense, and/or sell copies 
+    of the Software, and to permit persons to whom the Software is 
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be 
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+
+    $Id$
+*/
+
+#include <inttypes.h>
+
+#include "openservo.h"
+#include "config.h"
+#include "adc.h"
+#include "autotune.h"
+#include "controller.h"
+#include "pwm.h"
+#include "registers.h"
+
+#if AUTOTUNE_ENABLED
+
+//
+// Relay Feedback Autotune
+//
+// The autotune replaces the motion control output with a relay (bang-bang)
+// output of +/- REG_AUTOTUNE_RELAY around the seek position.  This drives
+// the servo into a limit cycle oscillation at the ultimate period Tu of the
+// servo.  The ultimate gain is then determined from the relay amplitude h
+// and the peak to peak amplitude p of the oscillation as:
+//
+//    Ku = 4h / (pi * p / 2) = 8h / (pi * p)
+//
+// The PID gains are then set using the Ziegler-Nichols rules:
+//
+//    Kp = 0.6 * Ku,  Ti = Tu / 2,  Td = Tu / 8
+//
+// The PID gains are fixed point values applied per sample so the period is
+// measured in samples.  The proportional and derivative gains are 8:8 and
+// the integral gain is 0:16 fixed point.  A gain too large for its fixed
+// point register is saturated and the autotune then reports
+// AUTOTUNE_STATUS_CLIPPED rather than AUTOTUNE_STATUS_DONE, as the gains
+// written no longer keep the Ziegler-Nichols ratios.
+//
+
+// The minimum and maximum servo position as defined by 10-bit ADC values.
+#define MIN_POSITION            (0)
+#define MAX_POSITION            (1023)
+
+// Number of oscillation cycles to let settle and then to measure.
+#define AUTOTUNE_SETTLE_CYCLES  2
+#define AUTOTUNE_MEASURE_CYCLES 4
+
+// Maximum number of samples the autotune may take at a 10 msec sample period.
+#define AUTOTUNE_TIMEOUT        1500
+
+// Exported variables.
+uint8_t autotune_running;
+
+// Values preserved across multiple autotune iterations.
+static int16_t setpoint;
+static int16_t relay_output;
+static int16_t minimum_position;
+static int16_t maximum_position;
+static int16_t peak_maximum;
+static int16_t peak_minimum;
+static uint16_t sample_count;
+static uint16_t cycle_start;
+static uint8_t cycle_count;
+
+
+static uint16_t autotune_saturate(uint32_t value, uint8_t *clipped)
+// Limit the value to an unsigned 16-bit value and flag if it was limited.
+{
+    if (value <= 0xFFFF) return (uint16_t) value;
+
+    *clipped = 1;
+
+    return 0xFFFF;
+}
+
+
+static void autotune_finish(uint8_t status)
+// Stop the autotune and report the status.
+{
+    autotune_running = 0;
+
+    banks_write_byte(BANK_STATUS, REG_AUTOTUNE_STATUS, status);
+}
+
+
+void autotune_init(void)
+// Initialize the autotune module.
+{
+    autotune_running = 0;
+
+    // Report that no autotune has been run.
+    banks_write_byte(BANK_STATUS, REG_AUTOTUNE_STATUS, AUTOTUNE_STATUS_IDLE);
+}
+
+
+void autotune_registers_defaults(void)
+// Initialize the autotune related register values.
+{
+    // Default relay amplitude and hysteresis.
+    banks_write_byte(BANK_CONFIG, REG_AUTOTUNE_RELAY, DEFAULT_AUTOTUNE_RELAY);
+    banks_write_byte(BANK_CONFIG, REG_AUTOTUNE_HYSTERESIS, DEFAULT_AUTOTUNE_HYSTERESIS);
+}
+
+
+void autotune_start(void)
+// Start a relay feedback autotune around the current seek position.
+{
+    int16_t relay;
+
+    // The tuning rules only apply to the PID controller.
+    if (banks_read_byte(BANK_CONFIG, REG_CONTROLLER_SELECT) != CONTROLLER_PID)
+    {
+        banks_write_byte(BANK_STATUS, REG_AUTOTUNE_STATUS, AUTOTUNE_STATUS_FAILED);
+        return;
+    }
+
+    // Get the seek position and the position limits.
+    setpoint = (int16_t) registers_read_word(REG_SEEK_POSITION_HI, REG_SEEK_POSITION_LO);
+    minimum_position = (int16_t) registers_read_word(REG_MIN_SEEK_HI, REG_MIN_SEEK_LO);
+    maximum_position = (int16_t) registers_read_word(REG_MAX_SEEK_HI, REG_MAX_SEEK_LO);
+
+    // Are we reversing the seek sense?
+    if (registers_read_byte(REG_REVERSE_SEEK) != 0)
+    {
+        int16_t temp = minimum_position;
+
+        // Yes. Reverse sense the seek and position limits.
+        setpoint = MAX_POSITION - setpoint;
+        minimum_position = MAX_POSITION - maximum_position;
+        maximum_position = MAX_POSITION - temp;
+    }
+
+    // Keep the setpoint within the position limits.
+    if (setpoint < minimum_position) setpoint = minimum_position;
+    if (setpoint > maximum_position) setpoint = maximum_position;
+
+    // Start driving in the positive direction.
+    relay = (int16_t) banks_read_byte(BANK_CONFIG, REG_AUTOTUNE_RELAY);
+    relay_output = relay;
+
+    // Reset the measurement.
+    sample_count = 0;
+    cycle_start = 0;
+    cycle_count = 0;
+    peak_maximum = setpoint;
+    peak_minimum = setpoint;
+
+    // Report the autotune as running.
+    autotune_running = 1;
+    banks_write_byte(BANK_STATUS, REG_AUTOTUNE_STATUS, AUTOTUNE_STATUS_RUNNING);
+}
+
+
+uint8_t autotune_compute_gains(uint8_t relay, uint16_t peak_to_peak, uint16_t period,
+                               uint16_t *ultimate_gain, uint16_t *p_gain,
+                               uint16_t *d_gain, uint16_t *i_gain)
+// Determine the ultimate gain and the PID gains from the relay amplitude
+// and the measured peak to peak oscillation and period.  Returns
+// AUTOTUNE_STATUS_DONE, AUTOTUNE_STATUS_CLIPPED if a gain saturated or
+// AUTOTUNE_STATUS_FAILED if the measurement can't be used.
+{
+    uint32_t ku;
+    uint32_t kp;
+    uint8_t clipped = 0;
+
+    // We need an oscillation to determine the gains.
+    if ((peak_to_peak == 0) || (period == 0)) return AUTOTUNE_STATUS_FAILED;
+
+    // Ku = 8h / (pi * p) as an 8:8 fixed point value, 256 * 8 / pi = 652.
+    ku = ((uint32_t) relay * 652) / peak_to_peak;
+
+    // Kp = 0.6 * Ku.
+    kp = (ku * 3) / 5;
+
+    // Set the ultimate gain and proportional gain.
+    *ultimate_gain = autotune_saturate(ku, &clipped);
+    *p_gain = autotune_saturate(kp, &clipped);
+
+    // Kd = Kp * Td = Kp * Tu / 8.
+    *d_gain = autotune_saturate((kp * period) / 8, &clipped);
+
+    // Ki = Kp / Ti = 2 * Kp / Tu scaled from 8:8 to 0:16 fixed point.
+    *i_gain = autotune_saturate((kp * 512) / period, &clipped);
+
+    return clipped ? AUTOTUNE_STATUS_CLIPPED : AUTOTUNE_STATUS_DONE;
+}
+
+
+int16_t autotune_position_to_pwm(int16_t position)
+// Take the 10-bit position as input and output the signed relay PWM to
+// be applied to the servo motors while the autotune is running.
+{
+    int16_t error;
+    int16_t relay;
+    int16_t hysteresis;
+
+    // Abort if the servo leaves the seek window.
+    if ((position < minimum_position) || (position > maximum_position))
+    {
+        autotune_finish(AUTOTUNE_STATUS_ABORTED);
+
+        return 0;
+    }
+
+    // Abort if the servo fails to oscillate in time.
+    if (++sample_count > AUTOTUNE_TIMEOUT * adc_get_sample_ticks())
+    {
+        autotune_finish(AUTOTUNE_STATUS_TIMEOUT);
+
+        return 0;
+    }
+
+    // Get the relay amplitude and hysteresis.
+    relay = (int16_t) banks_read_byte(BANK_CONFIG, REG_AUTOTUNE_RELAY);
+    hysteresis = (int16_t) banks_read_byte(BANK_CONFIG, REG_AUTOTUNE_HYSTERESIS);
+
+    // Track the oscillation peaks once the oscillation has settled.
+    if (cycle_count >= AUTOTUNE_SETTLE_CYCLES)
+    {
+        if (position > peak_maximum) peak_maximum = position;
+        if (position < peak_minimum) peak_minimum = position;
+    }
+
+    // Determine the position error.
+    error = setpoint - position;
+
+    // Switch the relay output with hysteresis.
+    if ((error < -hysteresis) && (relay_output > 0))
+    {
+        // Switch to the negative direction.
+        relay_output = -relay;
+    }
+    else if ((error > hysteresis) && (relay_output < 0))
+    {
+        // Switch to the positive direction.  This marks a new cycle.
+        relay_output = relay;
+        ++cycle_count;
+
+        // Start the measurement once the oscillation has settled.
+        if (cycle_count == AUTOTUNE_SETTLE_CYCLES)
+        {
+            cycle_start = sample_count;
+            peak_maximum = position;
+            peak_minimum = position;
+        }
+
+        // Have we measured enough cycles?
+        if (cycle_count == (AUTOTUNE_SETTLE_CYCLES + AUTOTUNE_MEASURE_CYCLES))
+        {
+            uint8_t status;
+            uint16_t period;
+            uint16_t ultimate_gain;
+            uint16_t p_gain;
+            uint16_t d_gain;
+            uint16_t i_gain;
+
+            // Determine the average oscillation period in samples.
+            period = (sample_count - cycle_start) / AUTOTUNE_MEASURE_CYCLES;
+
+            // Determine the gains from the measurement.
+            status = autotune_compute_gains((uint8_t) relay, (uint16_t) (peak_maximum - peak_minimum), period,
+                                            &ultimate_gain, &p_gain, &d_gain, &i_gain);
+
+            if (status != AUTOTUNE_STATUS_FAILED)
+            {
+                // Report the measurement.
+                banks_write_word(BANK_STATUS, REG_AUTOTUNE_KU_HI, REG_AUTOTUNE_KU_LO, ultimate_gain);
+                banks_write_word(BANK_STATUS, REG_AUTOTUNE_TU_HI, REG_AUTOTUNE_TU_LO, period);
+
+                // The derivative gain applies to the velocity in position units
+                // every 10 milliseconds rather than per sample.
+                d_gain /= adc_get_sample_ticks();
+
+                // Update the PID gains.
+                registers_write_word(REG_PID_PGAIN_HI, REG_PID_PGAIN_LO, p_gain);
+                registers_write_word(REG_PID_DGAIN_HI, REG_PID_DGAIN_LO, d_gain);
+                registers_write_word(REG_PID_IGAIN_HI, REG_PID_IGAIN_LO, i_gain);
+                registers_changed();
+            }
+
+            // Report done, done with a saturated gain or failed.
+            autotune_finish(status);
+
+            return 0;
+        }
+    }
+
+    // Return the relay output scaled to the PWM output resolution.
+    return relay_output << PWM_OUTPUT_SHIFT;
+}
+
+#endif // AUTOTUNE_ENABLED
@@ -0,0 +1,69 @@
+/*
+    Copyright (c) 2006 Michael P. Thompson <mpthompson@gmail.com>
+
+    Permission is hereby granted, free of charge, to any person 
+    obtaining a copy of this software and associated documentation 
+    files (the "Software"), to deal in the Software without 
+    restriction, including without limitation the rights to use, copy, 
+    modify, merge, publish, distribute, sublicense, and/or sell copies 
+    of the Software, and to permit persons to whom the Software is 
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be 
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+
+    $Id$
+*/
+
+#ifndef _OS_AUTOTUNE_H_
+#define _OS_AUTOTUNE_H_ 1
+
+// Autotune status values reported in REG_AUTOTUNE_STATUS.
+#define AUTOTUNE_STATUS_IDLE        0x00
+#define AUTOTUNE_STATUS_RUNNING     0x01
+#define AUTOTUNE_STATUS_DONE        0x02
+#define AUTOTUNE_STATUS_ABORTED     0x03
+#define AUTOTUNE_STATUS_TIMEOUT     0x04
+#define AUTOTUNE_STATUS_FAILED      0x05
+#define AUTOTUNE_STATUS_CLIPPED     0x06    // Done with a gain saturated.
+
+// Exported variables.
+extern uint8_t autotune_running;
+
+// Initialize the autotune module.
+void autotune_init(void);
+
+// Initialize the autotune related register values.
+void autotune_registers_defaults(void);
+
+// Start a relay feedback autotune around the current seek position.
+void autotune_start(void);
+
+// Take the 10-bit position as input and output the signed relay PWM to
+// be applied to the servo motors while the autotune is running.
+int16_t autotune_position_to_pwm(int16_t position);
+
+// Determine the ultimate gain and the PID gains from the relay amplitude
+// and the measured peak to peak oscillation and period.  Returns
+// AUTOTUNE_STATUS_DONE, AUTOTUNE_STATUS_CLIPPED if a gain saturated or
+// AUTOTUNE_STATUS_FAILED if the measurement can't be used.
+uint8_t autotune_compute_gains(uint8_t relay, uint16_t peak_to_peak, uint16_t period,
+                               uint16_t *ultimate_gain, uint16_t *p_gain,
+                               uint16_t *d_gain, uint16_t *i_gain);
+
+inline static uint8_t autotune_is_running(void)
+// Return whether the autotune is driving the servo.
+{
+    return autotune_running;
+}
+
+#endif // _OS_AUTOTUNE_H_
@@ -0,0 +1,115 @@
+/*
+    Copyright (c) 2006 Michael P. Thompson <mpthompson@gmail.com>
+
+    Permission is hereby granted, free of charge, to any person 
+    obtaining a copy of this software and associated documentation 
+    files (the "Software"), to deal in the Software without 
+    restriction, including without limitation the rights to use, copy, 
+    modify, merge, publish, distribute, sublicense, and/or sell copies 
+    of the Software, and to permit persons to whom the Software is 
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be 
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+
+    $Id$
+*/
+
+#include <inttypes.h>
+
+#include "openservo.h"
+#include "config.h"
+#include "bemf.h"
+#include "registers.h"
+
+// Compile following for back-EMF velocity measurement.
+#if BEMF_ENABLED
+
+//
+// Back-EMF Velocity Measurement
+//
+// The voltage generated by a spinning DC motor is proportional to its speed
+// so it gives a direct velocity measurement that is free of the noise and
+// lag of differencing the position.  When REG_BEMF_ENABLE is set the ADC
+// schedule floats the H-bridge once each sample period, discards
+// REG_BEMF_BLANKING conversions of about 104 usec each while the inductive
+// kick decays and then samples the motor voltage on BEMF_ADC_CHANNEL.
+//
+// The sample is converted to a velocity in 10-bit position units every 10
+// milliseconds as:
+//
+//   velocity = ((sample - REG_BEMF_OFFSET) * REG_BEMF_SCALE) / 16
+//
+// where REG_BEMF_OFFSET is the sample with the motor stopped and the signed
+// REG_BEMF_SCALE sets the gain and sense.  The velocity is reported in
+// REG_BEMF_VELOCITY with the seek sense applied and replaces the differenced
+// position velocity in the PID algorithm.  As the sample is taken after the
+// position sample the PID algorithm uses the velocity from the previous
+// sample period.
+//
+
+// Values preserved across multiple iterations.
+static int16_t bemf_velocity;
+
+
+void bemf_init(void)
+// Initialize the back-EMF velocity module.
+{
+    bemf_velocity = 0;
+}
+
+
+void bemf_registers_defaults(void)
+// Initialize the back-EMF velocity related register values.
+{
+    banks_write_byte(BANK_CONFIG, REG_BEMF_ENABLE, 0);
+    banks_write_byte(BANK_CONFIG, REG_BEMF_BLANKING, DEFAULT_BEMF_BLANKING);
+    banks_write_byte(BANK_CONFIG, REG_BEMF_SCALE, DEFAULT_BEMF_SCALE);
+    banks_write_word(BANK_CONFIG, REG_BEMF_OFFSET_HI, REG_BEMF_OFFSET_LO, DEFAULT_BEMF_OFFSET);
+}
+
+
+void bemf_update(uint16_t bemf)
+// Convert a back-EMF sample to a velocity and report it.
+{
+    int16_t offset;
+    int8_t scale;
+
+    // Get the offset and scale.
+    offset = (int16_t) banks_read_word(BANK_CONFIG, REG_BEMF_OFFSET_HI, REG_BEMF_OFFSET_LO);
+    scale = (int8_t) banks_read_byte(BANK_CONFIG, REG_BEMF_SCALE);
+
+    // Convert the sample to a velocity.
+    bemf_velocity = (int16_t) (((int32_t) ((int16_t) bemf - offset) * (int32_t) scale) >> 4);
+
+    // Report the velocity using the seek sense.
+    if (registers_read_byte(REG_REVERSE_SEEK) != 0)
+        banks_write_word(BANK_STATUS, REG_BEMF_VELOCITY_HI, REG_BEMF_VELOCITY_LO, (uint16_t) -bemf_velocity);
+    else
+        banks_write_word(BANK_STATUS, REG_BEMF_VELOCITY_HI, REG_BEMF_VELOCITY_LO, (uint16_t) bemf_velocity);
+}
+
+
+uint8_t bemf_velocity_is_selected(void)
+// Return non-zero if the back-EMF velocity should be used by the controller.
+{
+    return banks_read_byte(BANK_CONFIG, REG_BEMF_ENABLE);
+}
+
+
+int16_t bemf_get_velocity(void)
+// Return the back-EMF velocity.
+{
+    return bemf_velocity;
+}
+
+#endif // BEMF_ENABLED
@@ -0,0 +1,46 @@
+/*
+    Copyright (c) 2006 Michael P. Thompson <mpthompson@gmail.com>
+
+    Permission is hereby granted, free of charge, to any person 
+    obtaining a copy of this software and associated documentation 
+    files (the "Software"), to deal in the Software without 
+    restriction, including without limitation the rights to use, copy, 
+    modify, merge, publish, distribute, sublicense, and/or sell copies 
+    of the Software, and to permit persons to whom the Software is 
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be 
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+
+    $Id$
+*/
+
+#ifndef _OS_BEMF_H_
+#define _OS_BEMF_H_ 1
+
+// Initialize the back-EMF velocity module.
+void bemf_init(void);
+
+// Initialize the back-EMF velocity related register values.
+void bemf_registers_defaults(void);
+
+// Convert a back-EMF sample to a velocity and report it.
+void bemf_update(uint16_t bemf);
+
+// Return non-zero if the back-EMF velocity should be used by the controller.
+uint8_t bemf_velocity_is_selected(void);
+
+// Return the back-EMF velocity in 10-bit position units every 10 milliseconds
+// with positive values towards a higher raw position.
+int16_t bemf_get_velocity(void);
+
+#endif // _OS_BEMF_H_
@@ -0,0 +1,289 @@
+/*
+    Copyright (c) 2006 Michael P. Thompson <mpthompson@gmail.com>
+
+    Permission is hereby granted, free of charge, to any person 
+    obtaining a copy of this software and associated documentation 
+    files (the "Software"), to deal in the Software without 
+    restriction, including without limitation the rights to use, copy, 
+    modify, merge, publish, distribute, sublicense, and/or sell copies 
+    of the Software, and to permit persons to whom the Software is 
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be 
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+
+    $Id$
+*/
+
+#include <inttypes.h>
+
+#include "openservo.h"
+#include "config.h"
+#include "adc.h"
+#include "cascade.h"
+#include "controller.h"
+#include "pwm.h"
+#include "registers.h"
+
+// Compile following for cascade motion control algorithm.
+#if CASCADE_MOTION_ENABLED
+
+//
+// Cascaded Position/Velocity/Current Control
+//
+// The cascade algorithm splits control into three nested loops which all
+// run at the ADC sample rate:
+//
+//   seek --> position P --> velocity PI --> current PI --> motor --+--> position
+//               ^                ^                ^                |
+//               |                |                +--- current ----+
+//               |                +-------------------- velocity ---+
+//               +------------------------------------- position ---+
+//
+// The outer position loop is proportional and outputs a velocity setpoint
+// limited to REG_CASCADE_VELOCITY_LIMIT.  The velocity loop is PI and outputs
+// a current setpoint limited to REG_CASCADE_CURRENT_LIMIT.  The inner current
+// loop is PI and closes on the power ADC channel to output the PWM.  Load
+// disturbances show up in the current and velocity loops well before they
+// become a position error and the current limit is a natural torque limit.
+//
+// All gains are 8:8 fixed point proportional gains or 0:16 fixed point
+// integral gains.  Velocity is in position units per 10 msec and current
+// in power ADC units.  The power ADC only measures the magnitude of the
+// motor current, so the sign is taken from the last PWM output.
+//
+
+// The minimum and maximum servo position as defined by 10-bit ADC values.
+#define MIN_POSITION            (0)
+#define MAX_POSITION            (1023)
+
+// The minimum and maximum output.
+#define MAX_OUTPUT              (MAX_PWM_OUTPUT)
+#define MIN_OUTPUT              (-MAX_OUTPUT)
+
+// Values preserved across multiple cascade iterations.
+static int16_t previous_position;
+static int16_t previous_output;
+static uint16_t current_magnitude;
+static int32_t velocity_integral;
+static int32_t current_integral;
+
+//
+// Digital Lowpass Filter Implementation
+//
+// See: A Simple Software Lowpass Filter Suits Embedded-system Applications
+// http://www.edn.com/article/CA6335310.html
+//
+
+#define FILTER_SHIFT 1
+
+static int32_t filter_reg = 0;
+
+static int16_t filter_update(int16_t input)
+{
+    // Update the filter with the current input.
+    filter_reg = filter_reg - (filter_reg >> FILTER_SHIFT) + input;
+
+    // Scale output for unity gain.
+    return (int16_t) (filter_reg >> FILTER_SHIFT);
+}
+
+
+static int16_t cascade_limit(int32_t value, int16_t limit)
+// Limit the value to the range -limit to limit.
+{
+    if (value > limit) return limit;
+    if (value < -limit) return -limit;
+    return (int16_t) value;
+}
+
+
+static int16_t cascade_pi_update(int16_t error, uint16_t p_gain, uint16_t i_gain, int32_t *integral, int16_t limit, uint8_t shift)
+// Update a PI loop with the error and return the output with shift extra
+// bits of resolution limited to the range -limit to limit.  The integral is
+// clamped to the same range to prevent windup.
+{
+    int32_t limit_integral = (int32_t) limit << (16 - shift);
+
+    // Integrate the error and clamp the integral.
+    *integral += (int32_t) error * (int32_t) i_gain;
+    if (*integral > limit_integral) *integral = limit_integral;
+    if (*integral < -limit_integral) *integral = -limit_integral;
+
+    // Combine the proportional and integral components.
+    return cascade_limit((((int32_t) error * (int32_t) p_gain) >> (8 - shift)) + (*integral >> (16 - shift)), limit);
+}
+
+
+void cascade_init(void)
+// Initialize the cascade algorithm module.
+{
+    // Initialize preserved values.
+    previous_position = 0;
+    previous_output = 0;
+    current_magnitude = 0;
+    velocity_integral = 0;
+    current_integral = 0;
+}
+
+
+void cascade_registers_defaults(void)
+// Initialize the cascade algorithm related register values.  This is done
+// here to keep the cascade related code in a single file.
+{
+    // Default deadband.
+    registers_write_byte(REG_PID_DEADBAND, DEFAULT_PID_DEADBAND);
+
+    // Default position loop gain and velocity limit.
+    banks_write_word(BANK_CASCADE, REG_CASCADE_POSITION_GAIN_HI, REG_CASCADE_POSITION_GAIN_LO, DEFAULT_CASCADE_POSITION_GAIN);
+    banks_write_word(BANK_CASCADE, REG_CASCADE_VELOCITY_LIMIT_HI, REG_CASCADE_VELOCITY_LIMIT_LO, DEFAULT_CASCADE_VELOCITY_LIMIT);
+
+    // Default velocity loop gains and current limit.
+    banks_write_word(BANK_CASCADE, REG_CASCADE_VELOCITY_PGAIN_HI, REG_CASCADE_VELOCITY_PGAIN_LO, DEFAULT_CASCADE_VELOCITY_PGAIN);
+    banks_write_word(BANK_CASCADE, REG_CASCADE_VELOCITY_IGAIN_HI, REG_CASCADE_VELOCITY_IGAIN_LO, DEFAULT_CASCADE_VELOCITY_IGAIN);
+    banks_write_word(BANK_CASCADE, REG_CASCADE_CURRENT_LIMIT_HI, REG_CASCADE_CURRENT_LIMIT_LO, DEFAULT_CASCADE_CURRENT_LIMIT);
+
+    // Default current loop gains.
+    banks_write_word(BANK_CASCADE, REG_CASCADE_CURRENT_PGAIN_HI, REG_CASCADE_CURRENT_PGAIN_LO, DEFAULT_CASCADE_CURRENT_PGAIN);
+    banks_write_word(BANK_CASCADE, REG_CASCADE_CURRENT_IGAIN_HI, REG_CASCADE_CURRENT_IGAIN_LO, DEFAULT_CASCADE_CURRENT_IGAIN);
+
+    // Default position limits.
+    registers_write_word(REG_MIN_SEEK_HI, REG_MIN_SEEK_LO, DEFAULT_MIN_SEEK);
+    registers_write_word(REG_MAX_SEEK_HI, REG_MAX_SEEK_LO, DEFAULT_MAX_SEEK);
+
+    // Default reverse seek setting.
+    registers_write_byte(REG_REVERSE_SEEK, 0x00);
+}
+
+
+void cascade_current_update(uint16_t current)
+// Update the cascade algorithm with the 10-bit motor current.
+{
+    current_magnitude = current;
+}
+
+
+int16_t cascade_position_to_pwm(int16_t current_position)
+// This function takes the current servo position as input and outputs a pwm
+// value for the servo motors.  The current position value must be within the
+// range 0 and 1023. The output will be within the range of -MAX_PWM_OUTPUT and MAX_PWM_OUTPUT with
+// values less than zero indicating clockwise rotation and values more than
+// zero indicating counter-clockwise rotation.
+{
+    int16_t deadband;
+    int16_t seek_position;
+    int16_t seek_velocity;
+    int16_t minimum_position;
+    int16_t maximum_position;
+    int16_t filtered_position;
+    int16_t current_velocity;
+    int16_t current_signed;
+    int16_t position_error;
+    int16_t velocity_setpoint;
+    int16_t current_setpoint;
+    int16_t velocity_limit;
+    int16_t current_limit;
+    int16_t output;
+
+    // Filter the current position thru a digital low-pass filter.
+    filtered_position = filter_update(current_position);
+
+    // Use the filtered position to determine velocity.
+    current_velocity = filtered_position - previous_position;
+    previous_position = filtered_position;
+
+    // Scale the velocity to position units every 10 milliseconds to match
+    // the seek velocity regardless of the sample period.
+    current_velocity *= adc_get_sample_ticks();
+
+    // Get the seek position and velocity.
+    seek_position = (int16_t) registers_read_word(REG_SEEK_POSITION_HI, REG_SEEK_POSITION_LO);
+    seek_velocity = (int16_t) registers_read_word(REG_SEEK_VELOCITY_HI, REG_SEEK_VELOCITY_LO);
+
+    // Get the minimum and maximum position.
+    minimum_position = (int16_t) registers_read_word(REG_MIN_SEEK_HI, REG_MIN_SEEK_LO);
+    maximum_position = (int16_t) registers_read_word(REG_MAX_SEEK_HI, REG_MAX_SEEK_LO);
+
+    // Are we reversing the seek sense?
+    if (registers_read_byte(REG_REVERSE_SEEK) != 0)
+    {
+        // Yes. Update the position and velocity using reverse sense.
+        registers_write_word(REG_POSITION_HI, REG_POSITION_LO, (uint16_t) (MAX_POSITION - current_position));
+        registers_write_word(REG_VELOCITY_HI, REG_VELOCITY_LO, (uint16_t) -current_velocity);
+
+        // Reverse sense the seek and other position values.
+        seek_position = MAX_POSITION - seek_position;
+        seek_velocity = -seek_velocity;
+        minimum_position = MAX_POSITION - minimum_position;
+        maximum_position = MAX_POSITION - maximum_position;
+    }
+    else
+    {
+        // No. Update the position and velocity registers without change.
+        registers_write_word(REG_POSITION_HI, REG_POSITION_LO, (uint16_t) current_position);
+        registers_write_word(REG_VELOCITY_HI, REG_VELOCITY_LO, (uint16_t) current_velocity);
+    }
+
+    // Keep the seek position bound within the minimum and maximum position.
+    if (seek_position < minimum_position) seek_position = minimum_position;
+    if (seek_position > maximum_position) seek_position = maximum_position;
+
+    // Get the deadband and loop limits.
+    deadband = (int16_t) registers_read_byte(REG_PID_DEADBAND);
+    velocity_limit = (int16_t) banks_read_word(BANK_CASCADE, REG_CASCADE_VELOCITY_LIMIT_HI, REG_CASCADE_VELOCITY_LIMIT_LO);
+    current_limit = (int16_t) banks_read_word(BANK_CASCADE, REG_CASCADE_CURRENT_LIMIT_HI, REG_CASCADE_CURRENT_LIMIT_LO);
+
+#if FRICTION_ENABLED
+    // Report the error and velocity to the friction compensation.
+    controller_set_motion(seek_position - current_position, current_velocity);
+#endif
+
+    // Determine the position error ignoring errors within the deadband.
+    position_error = seek_position - filtered_position;
+    if ((position_error <= deadband) && (position_error >= -deadband)) position_error = 0;
+
+    // The position loop outputs a velocity setpoint with the seek velocity fed forward.
+    velocity_setpoint = cascade_limit((((int32_t) position_error *
+                                        (int32_t) banks_read_word(BANK_CASCADE, REG_CASCADE_POSITION_GAIN_HI, REG_CASCADE_POSITION_GAIN_LO)) >> 8) +
+                                      seek_velocity, velocity_limit);
+
+    // The velocity loop outputs a current setpoint.
+    current_setpoint = cascade_pi_update(velocity_setpoint - current_velocity,
+                                         banks_read_word(BANK_CASCADE, REG_CASCADE_VELOCITY_PGAIN_HI, REG_CASCADE_VELOCITY_PGAIN_LO),
+                                         banks_read_word(BANK_CASCADE, REG_CASCADE_VELOCITY_IGAIN_HI, REG_CASCADE_VELOCITY_IGAIN_LO),
+                                         &velocity_integral, current_limit, 0);
+
+    // The power ADC only measures the magnitude of the motor current so
+    // take the direction of the current from the last output.
+    current_signed = previous_output < 0 ? -((int16_t) current_magnitude) : (int16_t) current_magnitude;
+
+    // The current loop outputs the PWM.
+    output = cascade_pi_update(current_setpoint - current_signed,
+                               banks_read_word(BANK_CASCADE, REG_CASCADE_CURRENT_PGAIN_HI, REG_CASCADE_CURRENT_PGAIN_LO),
+                               banks_read_word(BANK_CASCADE, REG_CASCADE_CURRENT_IGAIN_HI, REG_CASCADE_CURRENT_IGAIN_LO),
+                               &current_integral, MAX_OUTPUT, PWM_OUTPUT_SHIFT);
+
+    // Reset the integrators while PWM is disabled so they don't wind up.
+    if (!(registers_read_byte(REG_FLAGS_LO) & (1<<FLAGS_LO_PWM_ENABLED)))
+    {
+        velocity_integral = 0;
+        current_integral = 0;
+        output = 0;
+    }
+
+    // Remember the output for the current direction.
+    previous_output = output;
+
+    return output;
+}
+
+#endif // CASCADE_MOTION_ENABLED
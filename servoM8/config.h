@@ -43,17 +43,20 @@
 // of Flash code space when enabled.
 #define TWI_CHECKED_ENABLED         1
 
+// The XXX_MOTION_ENABLED flags select which motion control
+// algorithms are included in the build.  Any combination of them
+// may be enabled as flash space allows and the algorithm used is
+// selected at runtime with the REG_CONTROLLER_SELECT register.
+
 // Enable (1) or disable (0) the PID algorithm for motion 
-// control in the motion.c module.  This setting cannot be
-// set when the other XXX_MOTION_ENABLED flags are set.
+// control in the pid.c module.
 //
 // NOTE: This is the motion control algorithm most people should
 // use until the other algorithms are further developed.
 #define PID_MOTION_ENABLED          1
 
 // Enable (1) or disable (0) the IPD algorithm for motion 
-// control in the motion.c module.  This setting cannot be
-// set when the other XXX_MOTION_ENABLED flags are set.
+// control in the ipd.c module.
 //
 // NOTE: The IPD algorithm is still under development and is
 // currently unstable.  Please contact Mike Thompson in the 
@@ -62,15 +65,21 @@
 #define IPD_MOTION_ENABLED          0
 
 // Enable (1) or disable (0) the state regulator algorithm
-// for motion control in the motion.c module.  This setting
-// cannot be set when the other XXX_MOTION_ENABLED flags are
-// set.
+// for motion control in the regulator.c module.
 //
 // NOTE: The state regulator code is still under development.  
 // Please contact Stefan Engelke in the OpenServo forums for 
 // more information before enabling this feature.
 #define REGULATOR_MOTION_ENABLED    0
 
+// Enable (1) or disable (0) the cascaded position/velocity/current
+// algorithm for motion control in the cascade.c module.
+//
+// NOTE: The cascade algorithm closes its inner loop on the motor
+// current measured by the power ADC channel and its gains must be
+// tuned from the inner loop outward before it is useful.
+#define CASCADE_MOTION_ENABLED      0
+
 // Enable (1) or disable (0) the Luenberg state estimator 
 // algorithm for determining servo speed.  It is a realtime 
 // simulation of the servo behavior with a internal controller 
@@ -90,6 +99,166 @@
 // indicating servo position and velocity at a particular time.
 #define CURVE_MOTION_ENABLED        1
 
+// Enable (1) or disable (0) gain scheduling within the PID algorithm.
+// When enabled the PID proportional and derivative gains are scaled
+// by factors interpolated from a small table indexed by the absolute
+// position error and, optionally, the position zone of the servo.
+// The table is kept in the write protected gain registers.
+#define PID_GAIN_SCHEDULE_ENABLED   0
+
+// Enable (1) or disable (0) the configurable position and derivative
+// path filters in the filter.c module.  When enabled the PID algorithm
+// filters the position and velocity separately with a first or second
+// order IIR or a moving average selected by the write protected filter
+// registers.  When disabled the original fixed first order filter is used.
+#define FILTER_ENABLED              0
+
+// Enable (1) or disable (0) the register selectable sample period.
+// When enabled the ADC sample timer is programmed for a 10, 5, 2 or 1
+// millisecond period from the write protected REG_SAMPLE_PERIOD register.
+// Velocities, the motion curve and the 10 millisecond timer register are
+// rescaled so that they keep their units at any sample period.
+#define ADC_SAMPLE_PERIOD_ENABLED   0
+
+// Enable (1) or disable (0) linearization of the position sensor in
+// the linear.c module.  When enabled the raw position is corrected by a
+// piecewise linear table held in write protected registers and saved to
+// EEPROM.  The table is filled by a calibration against host supplied
+// reference positions using the TWI_CMD_LINEAR_XXX commands.
+#define LINEAR_ENABLED              0
+
+// Enable (1) or disable (0) the friction and stiction compensation
+// stage in the friction.c module.  When enabled Coulomb friction
+// feedforward, a breakaway boost and dither set by the write protected
+// friction registers are added to the output of the motion control
+// algorithm before it is applied to the motor.
+#define FRICTION_ENABLED            0
+
+// Enable (1) or disable (0) oversampling of the position channel.  When
+// enabled the ADC takes 4^ADC_OVERSAMPLE_BITS back to back position samples
+// each sample period and decimates them to 10+ADC_OVERSAMPLE_BITS bits.
+// The result is reported in REG_POSITION_HIRES and used by the PID
+// algorithm while REG_POSITION stays a 10-bit value.  Each conversion takes
+// about 104 usec so 2 bits (16 conversions) needs a 2 msec or longer
+// sample period and 3 bits (64 conversions) the 10 msec sample period.
+// Shorter periods in REG_SAMPLE_PERIOD are rounded up to fit the burst.
+#define ADC_OVERSAMPLE_ENABLED      0
+#define ADC_OVERSAMPLE_BITS         2
+
+// Enable (1) or disable (0) the spike rejecting median prefilter of the
+// position channel.  When enabled the ADC interrupt keeps a ring of the
+// last ADC_MEDIAN_SIZE (3 or 5) position values and reports their median,
+// which removes single sample spikes from brush noise or worn pot wipers
+// at the cost of (ADC_MEDIAN_SIZE-1)/2 samples of delay.  A new sample that
+// differs from the median by more than ADC_MEDIAN_THRESHOLD 10-bit counts is
+// counted as a rejected outlier in REG_POSITION_OUTLIERS.
+#define ADC_MEDIAN_ENABLED          0
+#define ADC_MEDIAN_SIZE             3
+#define ADC_MEDIAN_THRESHOLD        16
+
+// Enable (1) or disable (0) the ADC sample FIFO in the fifo.c module.
+// When enabled the ADC interrupt pushes the sample tick, position and
+// power of each sample period into a ring buffer of FIFO_SIZE records
+// (6 bytes each) which the host drains in bulk through the REG_FIFO_STATUS
+// and REG_FIFO_DATA registers.
+#define FIFO_ENABLED                0
+#define FIFO_SIZE                   16
+
+// Enable (1) or disable (0) the table driven ADC channel scheduler.  When
+// enabled the channels sampled after the position are listed in a schedule
+// table in adc.c and each is sampled every Nth sample period as given by
+// its divisor.  A divisor of 0 only samples the channel on request, such as
+// the TWI_CMD_VOLTAGE_READ command.  The position is always sampled first
+// each sample period.  Only supported on the ATmega MCUs.
+#define ADC_SCHEDULE_ENABLED        0
+#define ADC_POWER_DIVISOR           1
+#define ADC_VOLTAGE_DIVISOR         0
+
+// Enable (1) or disable (0) back-EMF velocity measurement in the bemf.c
+// module.  When enabled and selected with REG_BEMF_ENABLE the H-bridge is
+// briefly floated each sample period so the motor back-EMF can be sampled
+// on the BEMF_ADC_CHANNEL analog input and used as the PID velocity.  This
+// requires ADC_SCHEDULE_ENABLED and is only supported on the ATmega8.
+#define BEMF_ENABLED                0
+#define BEMF_ADC_CHANNEL            3
+
+// Enable (1) or disable (0) the ADC pipeline health counters.  When enabled
+// the position and power samples carry sequence numbers and samples that
+// are overwritten before the main loop uses them are counted as overruns.
+// The largest gap in sample periods between position samples used by the
+// main loop is latched in REG_WORST_GAP until TWI_CMD_HEALTH_RESET.
+#define ADC_HEALTH_ENABLED          0
+
+// Enable (1) or disable (0) the timer/counter2 sample timebase on the
+// ATmega8.  When enabled the sample period is generated by timer/counter2
+// in clear timer on compare match mode rather than by reloading timer/
+// counter0 from its overflow interrupt, so interrupt latency no longer
+// shifts the sample period.  The spread of the latency from the compare
+// match to the start of the position conversion is reported in
+// REG_SAMPLE_JITTER.  Only supported on the ATmega8.
+#define ADC_TIMER2_ENABLED          0
+
+// Enable (1) or disable (0) synchronizing the power samples with the
+// motor PWM.  When enabled the power channel conversion is started from
+// the timer/counter1 overflow in the middle of the PWM on time rather than
+// immediately after the position conversion.  This adds up to one PWM
+// period of latency to the power sample.  Only supported on the ATmega8.
+#define ADC_POWER_SYNC_ENABLED      0
+
+// Enable (1) or disable (0) supply voltage compensation of the PWM in the
+// voltage.c module.  When enabled the supply voltage is sampled every
+// VOLTAGE_COMP_PERIOD sample periods and the PWM is scaled by the ratio
+// of REG_VOLTAGE_NOMINAL to REG_VOLTAGE just before it is applied so the
+// loop gain does not drift as the battery discharges.
+#define VOLTAGE_COMP_ENABLED        0
+#define VOLTAGE_COMP_PERIOD         10
+
+// Enable (1) or disable (0) the 10-bit PWM output path.  When enabled the
+// motion control algorithms output a signed PWM in the range -1023 to 1023
+// which is carried through pwm_update to the timer compare registers, making
+// low speed motion smoother with large PWM frequency dividers.  The gains
+// keep their meaning and the 8-bit REG_PWM_DIRA/REG_PWM_DIRB registers are
+// kept alongside the wider REG_PWM_WIDE_DIRA/REG_PWM_WIDE_DIRB registers.
+#define PWM_WIDE_ENABLED            0
+
+// Enable (1) or disable (0) the timer driven direction change dead time.
+// When enabled a direction change disables both H-bridge outputs and the
+// new output is enabled from the timer/counter1 overflow interrupt after
+// at least REG_PWM_DEADTIME PWM periods rather than busy waiting with
+// interrupts disabled.  Only supported on the ATmega8.
+#define PWM_DEADTIME_ENABLED        0
+
+// Enable (1) or disable (0) the selectable brake and coast drive modes.
+// When enabled REG_PWM_DRIVE_MODE selects whether a zero PWM output lets
+// the motor coast, shorts it through the H-bridge for a full brake or for
+// REG_PWM_BRAKE_DUTY of each PWM period.  It can also have a reversing
+// output of the motion control algorithm brake the motor with the same
+// duty while it is still moving faster than REG_PWM_BRAKE_VELOCITY rather
+// than drive it in reverse.  Braking drives OC1A and OC1B high together and
+// requires PWM_BRAKE_HALF_BRIDGE to confirm the H-bridge allows that.
+#define PWM_BRAKE_ENABLED           0
+
+// Set (1) only for H-bridges where OC1A and OC1B each drive their own half
+// bridge, so that both inputs high turns on the two low side (or the two
+// high side) MOSFETs and shorts the motor.  On H-bridges where each input
+// turns on a diagonal pair of MOSFETs both inputs high shorts the supply
+// and this must be left clear (0), which keeps braking from being built.
+#define PWM_BRAKE_HALF_BRIDGE       0
+
+// Enable (1) or disable (0) the output slew rate limiter in the slew.c
+// module.  When enabled the PWM output of the motion control algorithm is
+// moved no faster than REG_SLEW_RISE and REG_SLEW_FALL allow each sample
+// period, with an optional REG_SLEW_JERK limit on how fast that step grows,
+// before it is applied to the motor.
+#define SLEW_ENABLED                0
+
+// Enable (1) or disable (0) the relay feedback autotune.  When enabled
+// the TWI_CMD_AUTOTUNE command oscillates the servo around the seek
+// position with a bang-bang output, measures the ultimate gain and
+// period of the oscillation and sets the PID gains from them.  This
+// requires the PID_MOTION_ENABLED flag to be enabled.
+#define AUTOTUNE_ENABLED            0
+
 // Enable (1) or disable (0) some test motion code within the
 // main.c module.  This test code can be enabled to test basic
 // positioning of the OpenServo without a TWI master controlling
@@ -110,18 +279,33 @@
 #define SWAP_PWM_DIRECTION_ENABLED  0
 
 // Perform some sanity check of settings here.
-#if PID_MOTION_ENABLED && (IPD_MOTION_ENABLED || REGULATOR_MOTION_ENABLED)
-#  error "Conflicting configuration settings for PID_MOTION_ENABLED"
-#endif
-#if IPD_MOTION_ENABLED && (PID_MOTION_ENABLED || REGULATOR_MOTION_ENABLED)
-#  error "Conflicting configuration settings for MOTION_IPD_ENABLED"
-#endif
-#if REGULATOR_MOTION_ENABLED && (PID_MOTION_ENABLED || IPD_MOTION_ENABLED)
-#  error "Conflicting configuration settings for REGULATOR_MOTION_ENABLED"
+#if !PID_MOTION_ENABLED && !IPD_MOTION_ENABLED && !REGULATOR_MOTION_ENABLED && !CASCADE_MOTION_ENABLED
+#  error "Configuration settings require at least one XXX_MOTION_ENABLED flag."
 #endif
 #if REGULATOR_MOTION_ENABLED && !ESTIMATOR_ENABLED
 #  error "Configuration settings for REGULATOR_MOTION_ENABLED requires ESTIMATOR_ENABLED."
 #endif
+#if AUTOTUNE_ENABLED && !PID_MOTION_ENABLED
+#  error "Configuration settings for AUTOTUNE_ENABLED requires PID_MOTION_ENABLED."
+#endif
+#if ADC_OVERSAMPLE_ENABLED && ((ADC_OVERSAMPLE_BITS < 1) || (ADC_OVERSAMPLE_BITS > 3))
+#  error "Configuration settings for ADC_OVERSAMPLE_BITS must be between 1 and 3."
+#endif
+#if ADC_MEDIAN_ENABLED && (ADC_MEDIAN_SIZE != 3) && (ADC_MEDIAN_SIZE != 5)
+#  error "Configuration settings for ADC_MEDIAN_SIZE must be 3 or 5."
+#endif
+#if FIFO_ENABLED && ((FIFO_SIZE < 1) || (FIFO_SIZE > 127))
+#  error "Configuration settings for FIFO_SIZE must be between 1 and 127."
+#endif
+#if BEMF_ENABLED && !ADC_SCHEDULE_ENABLED
+#  error "Configuration settings for BEMF_ENABLED requires ADC_SCHEDULE_ENABLED."
+#endif
+#if PWM_BRAKE_ENABLED && !PWM_BRAKE_HALF_BRIDGE
+#  error "Configuration settings for PWM_BRAKE_ENABLED requires an H-bridge that allows PWM_BRAKE_HALF_BRIDGE."
+#endif
+#if VOLTAGE_COMP_ENABLED && (VOLTAGE_COMP_PERIOD < 1)
+#  error "Configuration settings for VOLTAGE_COMP_PERIOD must be at least 1."
+#endif
 #if CURVE_MOTION_ENABLED && PULSE_CONTROL_ENABLED
 #  warning "Conflicting configuration settings for CURVE_MOTION_ENABLED and PULSE_CONTROL_ENABLED"
 #endif
@@ -147,6 +331,37 @@
 #define DEFAULT_PID_PGAIN               0x0000
 #define DEFAULT_PID_DGAIN               0x0000
 #define DEFAULT_PID_IGAIN               0x0000
+#define DEFAULT_PID_VFF_GAIN            0x0000
+#define DEFAULT_PID_AFF_GAIN            0x0000
+#define DEFAULT_AUTOTUNE_RELAY          0x60
+#define DEFAULT_AUTOTUNE_HYSTERESIS     0x02
+#define DEFAULT_FILTER_POSITION_TYPE    0x01
+#define DEFAULT_FILTER_POSITION_COEFF   0x80
+#define DEFAULT_FILTER_VELOCITY_TYPE    0x01
+#define DEFAULT_FILTER_VELOCITY_COEFF   0x80
+#define DEFAULT_SAMPLE_PERIOD           10
+#define DEFAULT_FRICTION_COULOMB        0x00
+#define DEFAULT_FRICTION_BREAKAWAY      0x00
+#define DEFAULT_FRICTION_VELOCITY       0x01
+#define DEFAULT_FRICTION_DITHER         0x00
+#define DEFAULT_VOLTAGE_NOMINAL         0x0000
+#define DEFAULT_BEMF_BLANKING           0x02
+#define DEFAULT_BEMF_SCALE              0x10
+#define DEFAULT_BEMF_OFFSET             0x0000
+#define DEFAULT_PWM_DEADTIME            0x01
+#define DEFAULT_PWM_DRIVE_MODE          0x00
+#define DEFAULT_PWM_BRAKE_DUTY          0x80
+#define DEFAULT_PWM_BRAKE_VELOCITY      0x04
+#define DEFAULT_SLEW_RISE               0x00
+#define DEFAULT_SLEW_FALL               0x00
+#define DEFAULT_SLEW_JERK               0x00
+#define DEFAULT_CASCADE_POSITION_GAIN   0x0000
+#define DEFAULT_CASCADE_VELOCITY_LIMIT  0x0010
+#define DEFAULT_CASCADE_VELOCITY_PGAIN  0x0000
+#define DEFAULT_CASCADE_VELOCITY_IGAIN  0x0000
+#define DEFAULT_CASCADE_CURRENT_LIMIT   0x0100
+#define DEFAULT_CASCADE_CURRENT_PGAIN   0x0000
+#define DEFAULT_CASCADE_CURRENT_IGAIN   0x0000
 #define DEFAULT_PID_DEADBAND            0x00
 
 // Specify default mininimum and maximum seek positions.  The OpenServo will
@@ -163,6 +378,37 @@
 #define DEFAULT_PID_PGAIN               0x0600
 #define DEFAULT_PID_DGAIN               0x1800
 #define DEFAULT_PID_IGAIN               0x0000
+#define DEFAULT_PID_VFF_GAIN            0x0000
+#define DEFAULT_PID_AFF_GAIN            0x0000
+#define DEFAULT_AUTOTUNE_RELAY          0x60
+#define DEFAULT_AUTOTUNE_HYSTERESIS     0x02
+#define DEFAULT_FILTER_POSITION_TYPE    0x01
+#define DEFAULT_FILTER_POSITION_COEFF   0x80
+#define DEFAULT_FILTER_VELOCITY_TYPE    0x01
+#define DEFAULT_FILTER_VELOCITY_COEFF   0x80
+#define DEFAULT_SAMPLE_PERIOD           10
+#define DEFAULT_FRICTION_COULOMB        0x00
+#define DEFAULT_FRICTION_BREAKAWAY      0x00
+#define DEFAULT_FRICTION_VELOCITY       0x01
+#define DEFAULT_FRICTION_DITHER         0x00
+#define DEFAULT_VOLTAGE_NOMINAL         0x0000
+#define DEFAULT_BEMF_BLANKING           0x02
+#define DEFAULT_BEMF_SCALE              0x10
+#define DEFAULT_BEMF_OFFSET             0x0000
+#define DEFAULT_PWM_DEADTIME            0x01
+#define DEFAULT_PWM_DRIVE_MODE          0x00
+#define DEFAULT_PWM_BRAKE_DUTY          0x80
+#define DEFAULT_PWM_BRAKE_VELOCITY      0x04
+#define DEFAULT_SLEW_RISE               0x00
+#define DEFAULT_SLEW_FALL               0x00
+#define DEFAULT_SLEW_JERK               0x00
+#define DEFAULT_CASCADE_POSITION_GAIN   0x0000
+#define DEFAULT_CASCADE_VELOCITY_LIMIT  0x0010
+#define DEFAULT_CASCADE_VELOCITY_PGAIN  0x0000
+#define DEFAULT_CASCADE_VELOCITY_IGAIN  0x0000
+#define DEFAULT_CASCADE_CURRENT_LIMIT   0x0100
+#define DEFAULT_CASCADE_CURRENT_PGAIN   0x0000
+#define DEFAULT_CASCADE_CURRENT_IGAIN   0x0000
 #define DEFAULT_PID_DEADBAND            0x01
 
 // Futaba S3003 hardware default mininimum and maximum seek positions.
@@ -178,6 +424,37 @@
 #define DEFAULT_PID_PGAIN               0x0600
 #define DEFAULT_PID_DGAIN               0x1800
 #define DEFAULT_PID_IGAIN               0x0000
+#define DEFAULT_PID_VFF_GAIN            0x0000
+#define DEFAULT_PID_AFF_GAIN            0x0000
+#define DEFAULT_AUTOTUNE_RELAY          0x60
+#define DEFAULT_AUTOTUNE_HYSTERESIS     0x02
+#define DEFAULT_FILTER_POSITION_TYPE    0x01
+#define DEFAULT_FILTER_POSITION_COEFF   0x80
+#define DEFAULT_FILTER_VELOCITY_TYPE    0x01
+#define DEFAULT_FILTER_VELOCITY_COEFF   0x80
+#define DEFAULT_SAMPLE_PERIOD           10
+#define DEFAULT_FRICTION_COULOMB        0x00
+#define DEFAULT_FRICTION_BREAKAWAY      0x00
+#define DEFAULT_FRICTION_VELOCITY       0x01
+#define DEFAULT_FRICTION_DITHER         0x00
+#define DEFAULT_VOLTAGE_NOMINAL         0x0000
+#define DEFAULT_BEMF_BLANKING           0x02
+#define DEFAULT_BEMF_SCALE              0x10
+#define DEFAULT_BEMF_OFFSET             0x0000
+#define DEFAULT_PWM_DEADTIME            0x01
+#define DEFAULT_PWM_DRIVE_MODE          0x00
+#define DEFAULT_PWM_BRAKE_DUTY          0x80
+#define DEFAULT_PWM_BRAKE_VELOCITY      0x04
+#define DEFAULT_SLEW_RISE               0x00
+#define DEFAULT_SLEW_FALL               0x00
+#define DEFAULT_SLEW_JERK               0x00
+#define DEFAULT_CASCADE_POSITION_GAIN   0x0000
+#define DEFAULT_CASCADE_VELOCITY_LIMIT  0x0010
+#define DEFAULT_CASCADE_VELOCITY_PGAIN  0x0000
+#define DEFAULT_CASCADE_VELOCITY_IGAIN  0x0000
+#define DEFAULT_CASCADE_CURRENT_LIMIT   0x0100
+#define DEFAULT_CASCADE_CURRENT_PGAIN   0x0000
+#define DEFAULT_CASCADE_CURRENT_IGAIN   0x0000
 #define DEFAULT_PID_DEADBAND            0x01
 
 // Hitec HS-311 hardware default mininimum and maximum seek positions.
@@ -193,6 +470,37 @@
 #define DEFAULT_PID_PGAIN               0x0600
 #define DEFAULT_PID_DGAIN               0x1800
 #define DEFAULT_PID_IGAIN               0x0000
+#define DEFAULT_PID_VFF_GAIN            0x0000
+#define DEFAULT_PID_AFF_GAIN            0x0000
+#define DEFAULT_AUTOTUNE_RELAY          0x60
+#define DEFAULT_AUTOTUNE_HYSTERESIS     0x02
+#define DEFAULT_FILTER_POSITION_TYPE    0x01
+#define DEFAULT_FILTER_POSITION_COEFF   0x80
+#define DEFAULT_FILTER_VELOCITY_TYPE    0x01
+#define DEFAULT_FILTER_VELOCITY_COEFF   0x80
+#define DEFAULT_SAMPLE_PERIOD           10
+#define DEFAULT_FRICTION_COULOMB        0x00
+#define DEFAULT_FRICTION_BREAKAWAY      0x00
+#define DEFAULT_FRICTION_VELOCITY       0x01
+#define DEFAULT_FRICTION_DITHER         0x00
+#define DEFAULT_VOLTAGE_NOMINAL         0x0000
+#define DEFAULT_BEMF_BLANKING           0x02
+#define DEFAULT_BEMF_SCALE              0x10
+#define DEFAULT_BEMF_OFFSET             0x0000
+#define DEFAULT_PWM_DEADTIME            0x01
+#define DEFAULT_PWM_DRIVE_MODE          0x00
+#define DEFAULT_PWM_BRAKE_DUTY          0x80
+#define DEFAULT_PWM_BRAKE_VELOCITY      0x04
+#define DEFAULT_SLEW_RISE               0x00
+#define DEFAULT_SLEW_FALL               0x00
+#define DEFAULT_SLEW_JERK               0x00
+#define DEFAULT_CASCADE_POSITION_GAIN   0x0000
+#define DEFAULT_CASCADE_VELOCITY_LIMIT  0x0010
+#define DEFAULT_CASCADE_VELOCITY_PGAIN  0x0000
+#define DEFAULT_CASCADE_VELOCITY_IGAIN  0x0000
+#define DEFAULT_CASCADE_CURRENT_LIMIT   0x0100
+#define DEFAULT_CASCADE_CURRENT_PGAIN   0x0000
+#define DEFAULT_CASCADE_CURRENT_IGAIN   0x0000
 #define DEFAULT_PID_DEADBAND            0x01
 
 // Hitec HS-475HB hardware default mininimum and maximum seek positions.
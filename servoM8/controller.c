@@ -0,0 +1,301 @@
+/*
+    Copyright (c) 2006 Michael P. Thompson <mpthompson@gmail.com>
+
+    Permission is hereby granted, free of charge, to any person 
+    obtaining a copy of this software and associated documentation 
+    files (the "Software"), to deal in the Software without 
+    restriction, including without limitation the rights to use, copy, 
+    modify, merge, publish, distribute, sublicense, and/or sell copies 
+    of the Software, and to permit persons to whom the Software is 
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be 
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+
+    $Id$
+*/
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "openservo.h"
+#include "config.h"
+#include "cascade.h"
+#include "controller.h"
+#include "ipd.h"
+#include "pid.h"
+#include "pwm.h"
+#include "regulator.h"
+#include "registers.h"
+
+//
+// Runtime Controller Selection
+//
+// Each motion control algorithm included in the build by its
+// XXX_MOTION_ENABLED flag is entered into a dispatch table and the
+// algorithm used is selected at runtime by the REG_CONTROLLER_SELECT
+// register.  Selecting an algorithm that isn't included in the build
+// is ignored and the register reverts to the current controller.
+//
+// The algorithms all take their deadband and gains from the REG_PID_DEADBAND,
+// REG_PID_PGAIN, REG_PID_DGAIN and REG_PID_IGAIN registers.  So that each
+// keeps its own tuning, these registers of the outgoing controller are saved to
+// its slot in the controller bank and the gains of the incoming controller
+// are loaded from its slot when switching.
+//
+// Switching is bumpless.  The incoming controller is initialized and
+// primed with the current position and the difference between the last
+// output and its first output is then ramped out over a few samples.
+//
+
+// Local types.
+typedef struct controller_engine
+{
+    void (*init)(void);
+    void (*registers_defaults)(void);
+    int16_t (*position_to_pwm)(int16_t position);
+} controller_engine;
+
+// The maximum output.
+#define MAX_OUTPUT              (MAX_PWM_OUTPUT)
+
+// The amount the bumpless transfer offset is reduced each sample.
+#define TRANSFER_STEP           (4 << PWM_OUTPUT_SHIFT)
+
+// Marks that there is no controller with gains to save.
+#define CONTROLLER_NONE         0xFF
+
+// Dispatch table indexed by the controller identifier.
+static const controller_engine controller_table[CONTROLLER_COUNT] =
+{
+#if PID_MOTION_ENABLED
+    { pid_init, pid_registers_defaults, pid_position_to_pwm },
+#else
+    { NULL, NULL, NULL },
+#endif
+#if IPD_MOTION_ENABLED
+    { ipd_init, ipd_registers_defaults, ipd_position_to_pwm },
+#else
+    { NULL, NULL, NULL },
+#endif
+#if REGULATOR_MOTION_ENABLED
+    { regulator_init, regulator_registers_defaults, regulator_position_to_pwm },
+#else
+    { NULL, NULL, NULL },
+#endif
+#if CASCADE_MOTION_ENABLED
+    { cascade_init, cascade_registers_defaults, cascade_position_to_pwm },
+#else
+    { NULL, NULL, NULL },
+#endif
+};
+
+#if FRICTION_ENABLED
+// Position error and velocity reported by the last controller iteration.
+int16_t controller_error;
+int16_t controller_velocity;
+#endif
+
+// Values preserved across multiple controller iterations.
+static uint8_t controller_active;
+static int16_t previous_output;
+static int16_t transfer_offset;
+
+
+static uint8_t controller_is_valid(uint8_t controller)
+// Returns non-zero if the controller is included in the build.
+{
+    return (controller < CONTROLLER_COUNT) && (controller_table[controller].position_to_pwm != NULL);
+}
+
+
+static void controller_save_gains(uint8_t controller)
+// Save the deadband and gain registers to the controller slot.  With a
+// single controller there are no slots and the registers are left as is.
+{
+#if BANK_CONTROLLER_PRESENT
+    uint8_t i;
+    uint8_t slot = REG_CONTROLLER_GAINS + (controller * CONTROLLER_GAINS_SIZE);
+
+    for (i = 0; i < CONTROLLER_GAINS_SIZE; ++i)
+    {
+        banks_write_byte(BANK_CONTROLLER, slot + i, registers_read_byte(REG_PID_DEADBAND + i));
+    }
+#endif
+}
+
+
+static void controller_load_gains(uint8_t controller)
+// Load the deadband and gain registers from the controller slot.  With a
+// single controller there are no slots and the registers are left as is.
+{
+#if BANK_CONTROLLER_PRESENT
+    uint8_t i;
+    uint8_t slot = REG_CONTROLLER_GAINS + (controller * CONTROLLER_GAINS_SIZE);
+
+    for (i = 0; i < CONTROLLER_GAINS_SIZE; ++i)
+    {
+        registers_write_byte(REG_PID_DEADBAND + i, banks_read_byte(BANK_CONTROLLER, slot + i));
+    }
+
+    // The gain registers have changed.
+    registers_changed();
+#endif
+}
+
+
+void controller_init(void)
+// Initialize the controller module and the included controllers.
+{
+    uint8_t i;
+
+    // Initialize each of the included controllers.
+    for (i = 0; i < CONTROLLER_COUNT; ++i)
+    {
+        if (controller_table[i].init) controller_table[i].init();
+    }
+
+    // The gain registers already hold the gains of the selected controller.
+    controller_active = banks_read_byte(BANK_CONFIG, REG_CONTROLLER_SELECT);
+
+    // Fall back to the default controller if the selected one isn't included.
+    if (!controller_is_valid(controller_active))
+    {
+        controller_active = CONTROLLER_NONE;
+        banks_write_byte(BANK_CONFIG, REG_CONTROLLER_SELECT, DEFAULT_CONTROLLER);
+    }
+
+    // Initialize preserved values.
+    previous_output = 0;
+    transfer_offset = 0;
+#if FRICTION_ENABLED
+    controller_set_motion(0, 0);
+#endif
+}
+
+
+void controller_registers_defaults(void)
+// Initialize the register values of the included controllers.  Each
+// controller writes its default gains which are then saved to its slot.
+{
+    uint8_t i;
+
+    for (i = 0; i < CONTROLLER_COUNT; ++i)
+    {
+        if (controller_table[i].registers_defaults)
+        {
+            controller_table[i].registers_defaults();
+            controller_save_gains(i);
+        }
+    }
+
+    // Default to the first included controller.
+    banks_write_byte(BANK_CONFIG, REG_CONTROLLER_SELECT, DEFAULT_CONTROLLER);
+
+    // Each controller above overwrote the gain registers so load the
+    // gains of the default controller back into them.  controller_init()
+    // expects the gain registers to hold the gains of the selected one.
+    controller_load_gains(DEFAULT_CONTROLLER);
+
+    // A running default controller is switched to again so that it is
+    // initialized.  There are no gains in the registers to save for the
+    // outgoing controller.
+    controller_active = CONTROLLER_NONE;
+}
+
+
+void controller_registers_save(void)
+// Save the gain registers to the slot of the running controller so they are
+// saved to EEPROM along with the registers.  The slot of the running
+// controller is otherwise only updated when switching away from it.
+{
+    if (controller_active != CONTROLLER_NONE) controller_save_gains(controller_active);
+}
+
+
+void controller_registers_restore(void)
+// Switch to the controller selected by registers just restored from EEPROM.
+// The gain registers were restored along with the selection and already
+// belong to it, so no slot is saved or loaded.
+{
+    controller_active = banks_read_byte(BANK_CONFIG, REG_CONTROLLER_SELECT);
+
+    // Fall back to the default controller if the selected one isn't included.
+    if (!controller_is_valid(controller_active))
+    {
+        controller_active = CONTROLLER_NONE;
+        banks_write_byte(BANK_CONFIG, REG_CONTROLLER_SELECT, DEFAULT_CONTROLLER);
+        return;
+    }
+
+    // Start the restored controller from its initial state.
+    controller_table[controller_active].init();
+}
+
+
+int16_t controller_position_to_pwm(int16_t position)
+// Take the 10-bit position as input and output a signed PWM from the
+// selected controller to be applied to the servo motors.
+{
+    int16_t output;
+    uint8_t transfer = 0;
+    uint8_t controller = banks_read_byte(BANK_CONFIG, REG_CONTROLLER_SELECT);
+
+    // Ignore the selection of a controller not included in the build.
+    if (!controller_is_valid(controller))
+    {
+        controller = (controller_active == CONTROLLER_NONE) ? DEFAULT_CONTROLLER : controller_active;
+        banks_write_byte(BANK_CONFIG, REG_CONTROLLER_SELECT, controller);
+    }
+
+    // Has a different controller been selected?
+    if (controller != controller_active)
+    {
+        // Swap the gains of the outgoing controller for the incoming one.
+        if (controller_active != CONTROLLER_NONE) controller_save_gains(controller_active);
+        controller_load_gains(controller);
+
+        // Initialize and prime the incoming controller with the position
+        // so that its filters and derivatives start from the present state.
+        controller_table[controller].init();
+        controller_table[controller].position_to_pwm(position);
+
+        controller_active = controller;
+        transfer = 1;
+    }
+
+    // Get the output of the active controller.
+    output = controller_table[controller_active].position_to_pwm(position);
+
+    if (transfer)
+    {
+        // Start the transfer from the previous output.
+        transfer_offset = previous_output - output;
+    }
+    else
+    {
+        // Ramp the transfer offset towards zero.
+        if (transfer_offset > TRANSFER_STEP) transfer_offset -= TRANSFER_STEP;
+        else if (transfer_offset < -TRANSFER_STEP) transfer_offset += TRANSFER_STEP;
+        else transfer_offset = 0;
+    }
+
+    // Apply the transfer offset and limit the output.
+    output += transfer_offset;
+    if (output > MAX_OUTPUT) output = MAX_OUTPUT;
+    if (output < -MAX_OUTPUT) output = -MAX_OUTPUT;
+
+    // Remember the output for the next transfer.
+    previous_output = output;
+
+    return output;
+}
@@ -0,0 +1,100 @@
+/*
+    Copyright (c) 2006 Michael P. Thompson <mpthompson@gmail.com>
+
+    Permission is hereby granted, free of charge, to any person 
+    obtaining a copy of this software and associated documentation 
+    files (the "Software"), to deal in the Software without 
+    restriction, including without limitation the rights to use, copy, 
+    modify, merge, publish, distribute, sublicense, and/or sell copies 
+    of the Software, and to permit persons to whom the Software is 
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be 
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+
+    $Id$
+*/
+
+#ifndef _OS_CONTROLLER_H_
+#define _OS_CONTROLLER_H_ 1
+
+// Controller identifiers selected by the REG_CONTROLLER_SELECT register.
+#define CONTROLLER_PID          0x00
+#define CONTROLLER_IPD          0x01
+#define CONTROLLER_REGULATOR    0x02
+#define CONTROLLER_CASCADE      0x03
+#define CONTROLLER_COUNT        4
+
+// The default controller is the first one included in the build.
+#if PID_MOTION_ENABLED
+#define DEFAULT_CONTROLLER      CONTROLLER_PID
+#elif IPD_MOTION_ENABLED
+#define DEFAULT_CONTROLLER      CONTROLLER_IPD
+#elif REGULATOR_MOTION_ENABLED
+#define DEFAULT_CONTROLLER      CONTROLLER_REGULATOR
+#else
+#define DEFAULT_CONTROLLER      CONTROLLER_CASCADE
+#endif
+
+#if FRICTION_ENABLED
+// Position error and velocity of the last controller iteration in 10-bit
+// position units with positive values towards a higher raw position.  The
+// velocity is in position units every 10 milliseconds.  Declare externally
+// so in-lines work.
+extern int16_t controller_error;
+extern int16_t controller_velocity;
+#endif
+
+// Initialize the controller module and the included controllers.
+void controller_init(void);
+
+// Initialize the register values of the included controllers.
+void controller_registers_defaults(void);
+
+// Take the 10-bit position as input and output a signed PWM from the
+// selected controller to be applied to the servo motors.
+int16_t controller_position_to_pwm(int16_t position);
+
+// Save the gain registers to the slot of the running controller so they are
+// saved to EEPROM along with the registers.
+void controller_registers_save(void);
+
+// Switch to the controller selected by registers just restored from EEPROM.
+void controller_registers_restore(void);
+
+#if FRICTION_ENABLED
+
+// Record the position error and velocity of a controller iteration for the
+// friction compensation so it needn't read them back from the registers.
+inline static void controller_set_motion(int16_t error, int16_t velocity)
+{
+    controller_error = error;
+    controller_velocity = velocity;
+}
+
+
+// Get the position error of the last controller iteration.
+inline static int16_t controller_get_error(void)
+{
+    return controller_error;
+}
+
+
+// Get the velocity of the last controller iteration.
+inline static int16_t controller_get_velocity(void)
+{
+    return controller_velocity;
+}
+
+#endif // FRICTION_ENABLED
+
+#endif // _OS_CONTROLLER_H_
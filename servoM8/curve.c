@@ -90,7 +90,7 @@ void curve_init(uint16_t t0, uint16_t t1, float p0, float p1, float v0, float v1
 }
 
 
-void curve_solve(uint16_t t, float *x, float *dx)
+void curve_solve(uint16_t t, float *x, float *dx, float *ddx)
 {
     // Handle cases where t is outside and indise the curve.
     if (t <= curve_t0)
@@ -98,12 +98,14 @@ void curve_solve(uint16_t t, float *x, float *dx)
         // Set x and in and out dx.
         *x = curve_p0;
         *dx = t < curve_t0 ? 0.0 : curve_v0;
+        *ddx = 0.0;
     }
     else if (t >= curve_t1)
     {
         // Set x and in and out dx.
         *x = curve_p1;
         *dx = t > curve_t1 ? 0.0 : curve_v1;
+        *ddx = 0.0;
     }
     else
     {
@@ -120,9 +122,14 @@ void curve_solve(uint16_t t, float *x, float *dx)
         // dx = 3at^2 + 2bt + c
         *dx = (3.0 * curve_a * t2) + (2.0 * curve_b * t1) + curve_c;
 
+        // Determine the cubic polynomial second derivative.
+        // ddx = 6at + 2b
+        *ddx = (6.0 * curve_a * t1) + (2.0 * curve_b);
+
         // The time span has been normalized to 0.0 to 1.0 range so correct
-        // the derivative to the duration of the curve.
+        // the derivatives to the duration of the curve.
         *dx /= curve_duration_float;
+        *ddx /= curve_duration_float * curve_duration_float;
     }
 }
 
@@ -42,7 +42,7 @@ extern float curve_v1;
 
 // Curve methods.
 void curve_init(uint16_t t0, uint16_t t1, float p0, float p1, float v0, float v1);
-void curve_solve(uint16_t t, float *x, float *dx);
+void curve_solve(uint16_t t, float *x, float *dx, float *ddx);
 
 // Inline methods.
 inline static uint16_t curve_get_t0(void) { return curve_t0; }
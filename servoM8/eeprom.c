@@ -34,6 +34,15 @@
 #include "eeprom.h"
 #include "registers.h"
 
+// The write protected banks follow the read only status bank in the registers
+// array.  In EEPROM they directly follow the write protected and redirect registers.
+#define EEPROM_BANK_INDEX       BANK_REGISTER_INDEX(BANK_STATUS + 1, MIN_BANK_REGISTER)
+#define EEPROM_BANK_OFFSET      (2 + WRITE_PROTECT_REGISTER_COUNT + REDIRECT_REGISTER_COUNT)
+
+// Only the banks present are saved so the checksum is seeded with them as
+// well as the version to reject the image saved by a build with other banks.
+#define EEPROM_CHECKSUM_SEED    ((uint8_t) (EEPROM_VERSION + BANK_PRESENT_MASK))
+
 static uint8_t eeprom_checksum(const uint8_t *buffer, size_t size, uint8_t sum)
 // Adds the buffer to the checksum passed in returning the updated sum.
 {
@@ -82,6 +91,7 @@ uint8_t eeprom_restore_registers(void)
 // Restore registers from EEPROM.  Returns 1 if success or 0 if the registers failed 
 // checksum.  Upon failure the caller should initialize the registers to defaults.
 {
+    uint8_t sum;
     uint8_t header[2];
 
     // XXX Disable PWM to servo motor while reading registers.
@@ -95,8 +105,15 @@ uint8_t eeprom_restore_registers(void)
     // Read the write protected and redirect registers from EEPROM.
     eeprom_read_block(&registers[MIN_WRITE_PROTECT_REGISTER], (void *) 2, WRITE_PROTECT_REGISTER_COUNT + REDIRECT_REGISTER_COUNT);
 
+    // Read the write protected bank registers from EEPROM.
+    eeprom_read_block(&registers[EEPROM_BANK_INDEX], (void *) EEPROM_BANK_OFFSET, WRITE_PROTECT_BANK_REGISTER_COUNT);
+
+    // Determine the checksum across the write protected, redirect and bank registers.
+    sum = eeprom_checksum(&registers[MIN_WRITE_PROTECT_REGISTER], WRITE_PROTECT_REGISTER_COUNT + REDIRECT_REGISTER_COUNT, EEPROM_CHECKSUM_SEED);
+    sum = eeprom_checksum(&registers[EEPROM_BANK_INDEX], WRITE_PROTECT_BANK_REGISTER_COUNT, sum);
+
     // Does the checksum match?
-    if (header[1] != eeprom_checksum(&registers[MIN_WRITE_PROTECT_REGISTER], WRITE_PROTECT_REGISTER_COUNT + REDIRECT_REGISTER_COUNT, EEPROM_VERSION)) return 0;
+    if (header[1] != sum) return 0;
 
     // XXX Restore PWM to servo motor.
 
@@ -114,7 +131,8 @@ uint8_t eeprom_save_registers(void)
 
     // Fill in the EEPROM header.
     header[0] = EEPROM_VERSION;
-    header[1] = eeprom_checksum(&registers[MIN_WRITE_PROTECT_REGISTER], WRITE_PROTECT_REGISTER_COUNT + REDIRECT_REGISTER_COUNT, EEPROM_VERSION);
+    header[1] = eeprom_checksum(&registers[MIN_WRITE_PROTECT_REGISTER], WRITE_PROTECT_REGISTER_COUNT + REDIRECT_REGISTER_COUNT, EEPROM_CHECKSUM_SEED);
+    header[1] = eeprom_checksum(&registers[EEPROM_BANK_INDEX], WRITE_PROTECT_BANK_REGISTER_COUNT, header[1]);
 
     // Write the EEPROM header which is the first two bytes of EEPROM.
     eeprom_write_block(&header[0], (void *) 0, 2);
@@ -122,6 +140,9 @@ uint8_t eeprom_save_registers(void)
     // Write the write protected and redirect registers from EEPROM.
     eeprom_write_block(&registers[MIN_WRITE_PROTECT_REGISTER], (void *) 2, WRITE_PROTECT_REGISTER_COUNT + REDIRECT_REGISTER_COUNT);
 
+    // Write the write protected bank registers to EEPROM.
+    eeprom_write_block(&registers[EEPROM_BANK_INDEX], (void *) EEPROM_BANK_OFFSET, WRITE_PROTECT_BANK_REGISTER_COUNT);
+
     // XXX Restore PWM to servo motor.
 
     // Return success.
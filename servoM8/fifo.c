@@ -0,0 +1,164 @@
+/*
+    Copyright (c) 2006 Michael P. Thompson <mpthompson@gmail.com>
+
+    Permission is hereby granted, free of charge, to any person 
+    obtaining a copy of this software and associated documentation 
+    files (the "Software"), to deal in the Software without 
+    restriction, including without limitation the rights to use, copy, 
+    modify, merge, publish, distribute, sublicense, and/or sell copies 
+    of the Software, and to permit persons to whom the Software is 
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be 
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+
+    $Id$
+*/
+
+#include <inttypes.h>
+#include <avr/interrupt.h>
+
+#include "openservo.h"
+#include "config.h"
+#include "fifo.h"
+
+// Compile following for the sample FIFO.
+#if FIFO_ENABLED
+
+//
+// ADC Sample FIFO
+//
+// The ADC interrupt pushes a record of the sample tick, position and power
+// into this ring buffer each sample period.  The host drains the records
+// in bulk through the TWI registers:
+//
+// REG_FIFO_STATUS - The number of complete records waiting to be read.  The
+// FIFO_STATUS_OVERFLOW bit is set if records were dropped because the FIFO
+// was full.  Reading this register clears the overflow flag.
+//
+// REG_FIFO_DATA - Each read returns the next byte of the oldest record.  The
+// TWI address does not advance past this register so a single read
+// transaction of N * FIFO_RECORD_SIZE bytes drains N records.
+//
+// The sample tick counts sample periods and keeps counting while records are
+// dropped so the host can see where the gaps are.  Reads of an empty FIFO
+// return zero.
+//
+// Both the ADC and TWI interrupts run with interrupts disabled so the FIFO
+// needs no further locking between them.
+//
+
+static uint8_t fifo_buffer[FIFO_SIZE][FIFO_RECORD_SIZE];
+static uint8_t fifo_head;
+static uint8_t fifo_tail;
+static uint8_t fifo_count;
+static uint8_t fifo_offset;
+static uint8_t fifo_overflow;
+static uint16_t fifo_tick;
+
+
+void fifo_init(void)
+// Initialize the sample FIFO module.
+{
+    fifo_head = 0;
+    fifo_tail = 0;
+    fifo_count = 0;
+    fifo_offset = 0;
+    fifo_overflow = 0;
+    fifo_tick = 0;
+}
+
+
+void fifo_reset(void)
+// Discard all samples in the FIFO and clear the overflow flag.
+{
+    // Disable interrupts while the FIFO is emptied.
+    cli();
+
+    // Empty the FIFO, but keep the sample tick running.
+    fifo_head = 0;
+    fifo_tail = 0;
+    fifo_count = 0;
+    fifo_offset = 0;
+    fifo_overflow = 0;
+
+    // Restore interrupts.
+    sei();
+}
+
+
+void fifo_push(uint16_t position, uint16_t power)
+// Push the position and power values of a sample period into the FIFO.
+{
+    uint8_t *record;
+
+    // Count the sample period.
+    uint16_t tick = fifo_tick++;
+
+    // Drop the sample if the FIFO is full.
+    if (fifo_count >= FIFO_SIZE)
+    {
+        fifo_overflow = FIFO_STATUS_OVERFLOW;
+
+        return;
+    }
+
+    // Fill in the record at the head.
+    record = fifo_buffer[fifo_head];
+    record[0] = (uint8_t) (tick >> 8);
+    record[1] = (uint8_t) tick;
+    record[2] = (uint8_t) (position >> 8);
+    record[3] = (uint8_t) position;
+    record[4] = (uint8_t) (power >> 8);
+    record[5] = (uint8_t) power;
+
+    // Advance the head.
+    if (++fifo_head >= FIFO_SIZE) fifo_head = 0;
+    ++fifo_count;
+}
+
+
+uint8_t fifo_read_status(void)
+// Return the number of records in the FIFO along with the overflow flag.
+{
+    uint8_t status = fifo_count | fifo_overflow;
+
+    // Reading the status clears the overflow flag.
+    fifo_overflow = 0;
+
+    return status;
+}
+
+
+uint8_t fifo_read_byte(void)
+// Return the next byte of the oldest record in the FIFO.
+{
+    uint8_t data;
+
+    // Return zero if the FIFO is empty.
+    if (fifo_count == 0) return 0;
+
+    // Read the next byte of the record at the tail.
+    data = fifo_buffer[fifo_tail][fifo_offset];
+
+    // Remove the record once the last byte has been read.
+    if (++fifo_offset >= FIFO_RECORD_SIZE)
+    {
+        fifo_offset = 0;
+        if (++fifo_tail >= FIFO_SIZE) fifo_tail = 0;
+        --fifo_count;
+    }
+
+    return data;
+}
+
+#endif // FIFO_ENABLED
@@ -0,0 +1,55 @@
+/*
+    Copyright (c) 2006 Michael P. Thompson <mpthompson@gmail.com>
+
+    Permission is hereby granted, free of charge, to any person 
+    obtaining a copy of this software and associated documentation 
+    files (the "Software"), to deal in the Software without 
+    restriction, including without limitation the rights to use, copy, 
+    modify, merge, publish, distribute, sublicense, and/or sell copies 
+    of the Software, and to permit persons to whom the Software is 
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be 
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+
+    $Id$
+*/
+
+#ifndef _OS_FIFO_H_
+#define _OS_FIFO_H_ 1
+
+// Each sample record holds the big endian sample tick, 10-bit position
+// and power values.
+#define FIFO_RECORD_SIZE        6
+
+// The overflow flag in the FIFO status register.
+#define FIFO_STATUS_OVERFLOW    0x80
+
+// Initialize the sample FIFO module.
+void fifo_init(void);
+
+// Discard all samples in the FIFO and clear the overflow flag.
+void fifo_reset(void);
+
+// Push the position and power values of a sample period into the FIFO.
+// Called from the ADC interrupt.
+void fifo_push(uint16_t position, uint16_t power);
+
+// Return the number of complete records in the FIFO along with the overflow
+// flag.  Reading the status clears the overflow flag.
+uint8_t fifo_read_status(void);
+
+// Return the next byte of the oldest record in the FIFO.  The record is
+// removed once its last byte is read.
+uint8_t fifo_read_byte(void);
+
+#endif // _OS_FIFO_H_
@@ -0,0 +1,140 @@
+/*
+    Copyright (c) 2006 Michael P. Thompson <mpthompson@gmail.com>
+
+    Permission is hereby granted, free of charge, to any person 
+    obtaining a copy of this software and associated documentation 
+    files (the "Software"), to deal in the Software without 
+    restriction, including without limitation the rights to use, copy, 
+    modify, merge, publish, distribute, sublicense, and/or sell copies 
+    of the Software, and to permit persons to whom the Software is 
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be 
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+
+    $Id$
+*/
+
+#include <inttypes.h>
+
+#include "openservo.h"
+#include "config.h"
+#include "filter.h"
+
+// Compile following for configurable filters.
+#if FILTER_ENABLED
+
+//
+// Configurable Digital Lowpass Filters
+//
+// Each filter is configured by a type and a coefficient register:
+//
+// FILTER_TYPE_NONE     The input is passed through unchanged.
+// FILTER_TYPE_IIR1     First order IIR with y += a * (x - y).  The
+//                      coefficient is a in 0:8 fixed point so 0x80
+//                      is the original FILTER_SHIFT 1 filter.  Smaller
+//                      values filter more at the cost of more lag.
+// FILTER_TYPE_IIR2     Two cascaded first order IIR stages with the
+//                      same coefficient.  This is a critically damped
+//                      second order filter with a steeper rolloff.
+// FILTER_TYPE_AVERAGE  Moving average over 2^n samples where n is the
+//                      coefficient limited to FILTER_AVERAGE_SHIFT.  The
+//                      sum is kept in 32 bits as oversampled positions
+//                      reach 8184 and eight of them overflow 16 bits.
+//
+// The IIR stages are kept in 16:8 fixed point so that small coefficients
+// don't stall the output short of the input.  Changing the type or the
+// coefficient resets the filter to the current input so that the output
+// doesn't jump.
+//
+
+static int32_t filter_iir_update(int32_t state, uint8_t coefficient, int32_t input)
+// Update a single first order IIR stage kept in 16:8 fixed point.
+{
+    return state + (((input - state) * (int32_t) coefficient) >> 8);
+}
+
+
+static uint8_t filter_average_shift(uint8_t coefficient)
+// Return the moving average window as a power of two.
+{
+    return coefficient > FILTER_AVERAGE_SHIFT ? FILTER_AVERAGE_SHIFT : coefficient;
+}
+
+
+void filter_state_reset(filter_state *filter, uint8_t type, uint8_t coefficient, int16_t input)
+// Reset the filter so that its output settles at the input value.
+{
+    uint8_t i;
+
+    // Remember the configuration.
+    filter->type = type;
+    filter->coefficient = coefficient;
+
+    // Seed the IIR stages.
+    filter->stage1 = (int32_t) input << 8;
+    filter->stage2 = (int32_t) input << 8;
+
+    // Seed the moving average window.
+    filter->index = 0;
+    filter->sum = (int32_t) input << filter_average_shift(coefficient);
+    for (i = 0; i < FILTER_AVERAGE_WINDOW; ++i) filter->history[i] = input;
+}
+
+
+int16_t filter_state_update(filter_state *filter, uint8_t type, uint8_t coefficient, int16_t input)
+// Update the filter with the input and return the filtered output.
+{
+    // Reset the filter if the configuration changed.
+    if ((type != filter->type) || (coefficient != filter->coefficient))
+    {
+        filter_state_reset(filter, type, coefficient, input);
+    }
+
+    switch (type)
+    {
+        case FILTER_TYPE_IIR1:
+
+            // Single first order stage.
+            filter->stage1 = filter_iir_update(filter->stage1, coefficient, (int32_t) input << 8);
+
+            return (int16_t) ((filter->stage1 + 0x80) >> 8);
+
+        case FILTER_TYPE_IIR2:
+
+            // Two cascaded first order stages.
+            filter->stage1 = filter_iir_update(filter->stage1, coefficient, (int32_t) input << 8);
+            filter->stage2 = filter_iir_update(filter->stage2, coefficient, filter->stage1);
+
+            return (int16_t) ((filter->stage2 + 0x80) >> 8);
+
+        case FILTER_TYPE_AVERAGE:
+        {
+            uint8_t shift = filter_average_shift(coefficient);
+
+            // Replace the oldest sample in the window with the input.
+            filter->index = (filter->index + 1) & ((1 << shift) - 1);
+            filter->sum += input - filter->history[filter->index];
+            filter->history[filter->index] = input;
+
+            return (int16_t) (filter->sum >> shift);
+        }
+
+        default:
+            break;
+    }
+
+    // No filtering.
+    return input;
+}
+
+#endif // FILTER_ENABLED
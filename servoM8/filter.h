@@ -0,0 +1,58 @@
+/*
+    Copyright (c) 2006 Michael P. Thompson <mpthompson@gmail.com>
+
+    Permission is hereby granted, free of charge, to any person 
+    obtaining a copy of this software and associated documentation 
+    files (the "Software"), to deal in the Software without 
+    restriction, including without limitation the rights to use, copy, 
+    modify, merge, publish, distribute, sublicense, and/or sell copies 
+    of the Software, and to permit persons to whom the Software is 
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be 
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+
+    $Id$
+*/
+
+#ifndef _OS_FILTER_H_
+#define _OS_FILTER_H_ 1
+
+// Filter types selected by the filter type registers.
+#define FILTER_TYPE_NONE        0x00
+#define FILTER_TYPE_IIR1        0x01
+#define FILTER_TYPE_IIR2        0x02
+#define FILTER_TYPE_AVERAGE     0x03
+
+// Maximum moving average window as a power of two.
+#define FILTER_AVERAGE_SHIFT    3
+#define FILTER_AVERAGE_WINDOW   (1 << FILTER_AVERAGE_SHIFT)
+
+// Filter state type.
+typedef struct filter_state
+{
+    uint8_t type;
+    uint8_t coefficient;
+    uint8_t index;
+    int32_t sum;
+    int32_t stage1;
+    int32_t stage2;
+    int16_t history[FILTER_AVERAGE_WINDOW];
+} filter_state;
+
+// Reset the filter so that its output settles at the input value.
+void filter_state_reset(filter_state *filter, uint8_t type, uint8_t coefficient, int16_t input);
+
+// Update the filter with the input and return the filtered output.
+int16_t filter_state_update(filter_state *filter, uint8_t type, uint8_t coefficient, int16_t input);
+
+#endif // _OS_FILTER_H_
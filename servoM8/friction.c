@@ -0,0 +1,172 @@
+/*
+    Copyright (c) 2006 Michael P. Thompson <mpthompson@gmail.com>
+
+    Permission is hereby granted, free of charge, to any person 
+    obtaining a copy of this software and associated documentation 
+    files (the "Software"), to deal in the Software without 
+    restriction, including without limitation the rights to use, copy, 
+    modify, merge, publish, distribute, sublicense, and/or sell copies 
+    of the Software, and to permit persons to whom the Software is 
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be 
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+
+    $Id$
+*/
+
+#include <inttypes.h>
+
+#include "openservo.h"
+#include "config.h"
+#include "friction.h"
+#include "pwm.h"
+#include "registers.h"
+
+// Compile following for friction compensation.
+#if FRICTION_ENABLED
+
+//
+// Friction and Stiction Compensation
+//
+// Geared servos need a fair amount of torque to start moving and a little
+// less to keep moving.  A small position error therefore produces no motion
+// until the integral or proportional term grows past the breakaway torque
+// at which point the servo jumps and overshoots.  This stage sits between
+// the motion control algorithm and pwm_update and adds:
+//
+// Coulomb friction feedforward - REG_FRICTION_COULOMB is added in the
+// direction of motion while the servo is moving faster than the
+// REG_FRICTION_VELOCITY threshold.
+//
+// Breakaway boost - REG_FRICTION_BREAKAWAY is added in the direction of the
+// position error while the servo is stationary and the error is outside the
+// deadband.
+//
+// Dither - REG_FRICTION_DITHER is alternately added and subtracted on each
+// sample while the error is outside the deadband to keep the gear train
+// from sticking.
+//
+// All values are in 8-bit PWM units.  Setting a value to zero disables that part
+// of the compensation.
+//
+// The position error and velocity are reported by the selected motion control
+// algorithm each sample through controller_set_motion() rather than read back
+// from the registers.
+//
+
+// The maximum output.
+#define MAX_OUTPUT              (MAX_PWM_OUTPUT)
+
+// Values preserved across multiple iterations.
+static uint8_t dither_phase;
+
+// Parameters decoded from the registers.  These are only refreshed when
+// the register write count shows the registers have changed.
+static uint8_t parameters_write_count;
+static int16_t parameters_deadband;
+static int16_t parameters_threshold;
+static int16_t parameters_coulomb;
+static int16_t parameters_breakaway;
+static int16_t parameters_dither;
+
+
+static void friction_parameters_refresh(void)
+// Refresh the decoded parameters if the registers have changed.
+{
+    // Have the registers changed since the parameters were decoded?
+    if (parameters_write_count == registers_get_write_count()) return;
+
+    // Remember the count before reading so that a write during the
+    // refresh causes another refresh.
+    parameters_write_count = registers_get_write_count();
+
+    // Get the deadband and the velocity below which the servo is considered stationary.
+    parameters_deadband = (int16_t) registers_read_byte(REG_PID_DEADBAND);
+    parameters_threshold = (int16_t) banks_read_byte(BANK_CONFIG, REG_FRICTION_VELOCITY);
+
+    // Get the compensation values scaled to the PWM output.
+    parameters_coulomb = (int16_t) banks_read_byte(BANK_CONFIG, REG_FRICTION_COULOMB) << PWM_OUTPUT_SHIFT;
+    parameters_breakaway = (int16_t) banks_read_byte(BANK_CONFIG, REG_FRICTION_BREAKAWAY) << PWM_OUTPUT_SHIFT;
+    parameters_dither = (int16_t) banks_read_byte(BANK_CONFIG, REG_FRICTION_DITHER) << PWM_OUTPUT_SHIFT;
+}
+
+
+void friction_init(void)
+// Initialize the friction compensation module.
+{
+    // Initialize preserved values.
+    dither_phase = 0;
+
+    // Force the parameters to be refreshed.
+    parameters_write_count = registers_get_write_count() - 1;
+}
+
+
+void friction_registers_defaults(void)
+// Initialize the friction compensation related register values.
+{
+    banks_write_byte(BANK_CONFIG, REG_FRICTION_COULOMB, DEFAULT_FRICTION_COULOMB);
+    banks_write_byte(BANK_CONFIG, REG_FRICTION_BREAKAWAY, DEFAULT_FRICTION_BREAKAWAY);
+    banks_write_byte(BANK_CONFIG, REG_FRICTION_VELOCITY, DEFAULT_FRICTION_VELOCITY);
+    banks_write_byte(BANK_CONFIG, REG_FRICTION_DITHER, DEFAULT_FRICTION_DITHER);
+}
+
+
+int16_t friction_compensate(int16_t error, int16_t velocity, int16_t pwm)
+// Take the position error and velocity reported by the motion control
+// algorithm and its signed PWM output as input and output the friction
+// compensated signed PWM.  The error and velocity are in 10-bit position
+// units with positive values towards a higher raw position.
+{
+    // Refresh the parameters if the registers have changed.
+    friction_parameters_refresh();
+
+    // Ignore errors within the deadband.
+    if ((error <= parameters_deadband) && (error >= -parameters_deadband)) error = 0;
+
+    if (velocity > parameters_threshold)
+    {
+        // Moving up.  Compensate for Coulomb friction.
+        pwm += parameters_coulomb;
+    }
+    else if (velocity < -parameters_threshold)
+    {
+        // Moving down.  Compensate for Coulomb friction.
+        pwm -= parameters_coulomb;
+    }
+    else if (error > 0)
+    {
+        // Stationary below the seek position.  Boost past the breakaway torque.
+        pwm += parameters_breakaway;
+    }
+    else if (error < 0)
+    {
+        // Stationary above the seek position.  Boost past the breakaway torque.
+        pwm -= parameters_breakaway;
+    }
+
+    // Dither the output while there is a position error.
+    if (error != 0)
+    {
+        dither_phase ^= 1;
+        pwm += dither_phase ? parameters_dither : -parameters_dither;
+    }
+
+    // Limit the output.
+    if (pwm > MAX_OUTPUT) pwm = MAX_OUTPUT;
+    if (pwm < -MAX_OUTPUT) pwm = -MAX_OUTPUT;
+
+    return pwm;
+}
+
+#endif // FRICTION_ENABLED
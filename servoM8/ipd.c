@@ -28,7 +28,10 @@
 
 #include "openservo.h"
 #include "config.h"
+#include "adc.h"
+#include "controller.h"
 #include "ipd.h"
+#include "pwm.h"
 #include "registers.h"
 
 // Compile following for IPD motion control algorithm.
@@ -135,7 +138,7 @@ void ipd_registers_defaults(void)
 int16_t ipd_position_to_pwm(int16_t current_position)
 // This function takes the current servo position as input and outputs a pwm
 // value for the servo motors.  The current position value must be within the
-// range 0 and 1023. The output will be within the range of -255 and 255 with
+// range 0 and 1023. The output will be within the range of -MAX_PWM_OUTPUT and MAX_PWM_OUTPUT with
 // values less than zero indicating clockwise rotation and values more than
 // zero indicating counter-clockwise rotation.
 //
@@ -217,6 +220,12 @@ int16_t ipd_position_to_pwm(int16_t current_position)
     // The command error is the difference between the command position and current position.
     command_error = command_position - current_position;
 
+#if FRICTION_ENABLED
+    // Report the error and the velocity every 10 milliseconds to the
+    // friction compensation.
+    controller_set_motion(command_error, current_velocity * adc_get_sample_ticks());
+#endif
+
     // Adjust proportional error due to deadband.  The potentiometer readings are a 
     // bit noisy and there is typically one or two units of difference from reading 
     // to reading when the servo is holding position.  Adding deadband decreases some 
@@ -286,8 +295,8 @@ int16_t ipd_position_to_pwm(int16_t current_position)
         output = MAX_OUTPUT;
     }
 
-    // Return the output.
-    return output;
+    // Return the output scaled to the PWM output resolution.
+    return output << PWM_OUTPUT_SHIFT;
 }
 
 #endif // IPD_MOTION_ENABLED
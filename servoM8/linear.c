@@ -0,0 +1,232 @@
+/*
+    Copyright (c) 2006 Michael P. Thompson <mpthompson@gmail.com>
+
+    Permission is hereby granted, free of charge, to any person 
+    obtaining a copy of this software and associated documentation 
+    files (the "Software"), to deal in the Software without 
+    restriction, including without limitation the rights to use, copy, 
+    modify, merge, publish, distribute, sublicense, and/or sell copies 
+    of the Software, and to permit persons to whom the Software is 
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be 
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+
+    $Id$
+*/
+
+#include <inttypes.h>
+
+#include "openservo.h"
+#include "config.h"
+#include "linear.h"
+#include "registers.h"
+
+// Compile following for position linearization.
+#if LINEAR_ENABLED
+
+//
+// Position Sensor Linearization
+//
+// The position pot is not quite linear, particularly near the ends of its
+// travel.  The linearization table holds a signed correction in position
+// units at every 64th raw position from 0 to 1024 and the correction for a
+// raw position is interpolated between the two nearest points.  The table
+// is kept in a write protected register bank so it is saved to EEPROM
+// along with the other write protected registers.
+//
+// The table is filled by a calibration driven by the host:
+//
+// 1. TWI_CMD_LINEAR_START clears the recorded reference points and disables
+//    the table so that raw positions are used.
+// 2. For each reference point the host moves the servo to a position it
+//    knows accurately, writes that position to REG_LINEAR_REFERENCE and
+//    sends TWI_CMD_LINEAR_POINT to record it against the raw position.
+// 3. TWI_CMD_LINEAR_FINISH interpolates the corrections at each table point
+//    from the recorded references and enables the table.  The host then
+//    saves the registers to EEPROM with TWI_CMD_REGISTERS_SAVE.
+//
+// REG_LINEAR_STATUS reports the number of recorded references while
+// calibrating and LINEAR_STATUS_FAILED if the calibration failed.
+//
+// The calibration sweep is driven point by point from the host rather than
+// run by the servo on its own.  Only the host knows the true position at
+// each point of the sweep and it has to wait for the servo to settle and
+// take its external measurement before the point is recorded.
+//
+
+// The maximum servo position as defined by 10-bit ADC values.
+#define MAX_POSITION            (1023)
+
+// The largest correction which fits in a table point.
+#define MAX_CORRECTION          (127)
+
+// Recorded calibration reference points sorted by raw position.
+static uint8_t reference_count;
+static uint16_t reference_raw[LINEAR_MAX_REFERENCES];
+static uint16_t reference_true[LINEAR_MAX_REFERENCES];
+
+// The last raw 10-bit position.
+static uint16_t raw_position;
+
+
+void linear_init(void)
+// Initialize the linearization module.
+{
+    // Initialize preserved values.
+    reference_count = 0;
+    raw_position = 0;
+}
+
+
+void linear_registers_defaults(void)
+// Initialize the linearization related register values.
+{
+    uint8_t i;
+
+    // Default to a disabled table with no corrections.
+    for (i = 0; i < LINEAR_POINTS; ++i) banks_write_byte(BANK_LINEAR, REG_LINEAR_POINT_0 + i, 0);
+    banks_write_byte(BANK_LINEAR, REG_LINEAR_ENABLE, 0);
+    banks_write_word(BANK_LINEAR, REG_LINEAR_REFERENCE_HI, REG_LINEAR_REFERENCE_LO, 0);
+}
+
+
+uint16_t linear_correct(uint16_t position, uint8_t shift)
+// Take the raw position with shift extra bits of resolution and return the
+// linearized position with the same resolution.
+{
+    uint8_t index;
+    uint16_t fraction;
+    uint16_t span;
+    int16_t correction;
+    int32_t corrected;
+
+    // Remember the raw position for calibration.
+    raw_position = position >> shift;
+
+    // Is the table enabled?
+    if (!banks_read_byte(BANK_LINEAR, REG_LINEAR_ENABLE)) return position;
+
+    // Determine the table point below the position and how far past it the position is.
+    span = (uint16_t) 1 << (LINEAR_POINT_SHIFT + shift);
+    index = (uint8_t) (position >> (LINEAR_POINT_SHIFT + shift));
+    fraction = position & (span - 1);
+
+    // Interpolate the correction between the table points.
+    correction = (int16_t) (((int32_t) (int8_t) banks_read_byte(BANK_LINEAR, REG_LINEAR_POINT_0 + index) * (int32_t) (span - fraction) +
+                             (int32_t) (int8_t) banks_read_byte(BANK_LINEAR, REG_LINEAR_POINT_0 + index + 1) * (int32_t) fraction) >> LINEAR_POINT_SHIFT);
+
+    // Apply the correction and keep the position within range.
+    corrected = (int32_t) position + correction;
+    if (corrected < 0) corrected = 0;
+    if (corrected > ((int32_t) MAX_POSITION << shift)) corrected = (int32_t) MAX_POSITION << shift;
+
+    return (uint16_t) corrected;
+}
+
+
+void linear_calibrate_start(void)
+// Start a calibration by clearing the recorded reference points.
+{
+    // Use raw positions while calibrating.
+    banks_write_byte(BANK_LINEAR, REG_LINEAR_ENABLE, 0);
+
+    // Clear the recorded references.
+    reference_count = 0;
+    banks_write_byte(BANK_STATUS, REG_LINEAR_STATUS, reference_count);
+}
+
+
+void linear_calibrate_point(void)
+// Record the last raw position against the host supplied reference position.
+{
+    uint8_t i;
+    uint16_t reference = banks_read_word(BANK_LINEAR, REG_LINEAR_REFERENCE_HI, REG_LINEAR_REFERENCE_LO);
+
+    // Ignore references once the table is full.
+    if (reference_count >= LINEAR_MAX_REFERENCES) return;
+
+    // Insert the reference keeping them sorted by raw position.
+    for (i = reference_count; (i > 0) && (reference_raw[i - 1] > raw_position); --i)
+    {
+        reference_raw[i] = reference_raw[i - 1];
+        reference_true[i] = reference_true[i - 1];
+    }
+    reference_raw[i] = raw_position;
+    reference_true[i] = reference;
+    ++reference_count;
+
+    // Report the number of references.
+    banks_write_byte(BANK_STATUS, REG_LINEAR_STATUS, reference_count);
+}
+
+
+void linear_calibrate_finish(void)
+// Fill the linearization table from the recorded reference points.
+{
+    uint8_t i;
+    uint8_t j;
+    int16_t raw;
+    int16_t correction;
+
+    // At least two distinct references are needed.
+    if ((reference_count < 2) || (reference_raw[0] == reference_raw[reference_count - 1]))
+    {
+        banks_write_byte(BANK_STATUS, REG_LINEAR_STATUS, LINEAR_STATUS_FAILED);
+        return;
+    }
+
+    for (i = 0, j = 0; i < LINEAR_POINTS; ++i)
+    {
+        raw = (int16_t) i << LINEAR_POINT_SHIFT;
+
+        // Find the references either side of the table point.
+        while ((j < (reference_count - 2)) && (reference_raw[j + 1] <= raw)) ++j;
+
+        if (raw <= (int16_t) reference_raw[0])
+        {
+            // Hold the first correction below the first reference.
+            correction = (int16_t) reference_true[0] - (int16_t) reference_raw[0];
+        }
+        else if (raw >= (int16_t) reference_raw[reference_count - 1])
+        {
+            // Hold the last correction above the last reference.
+            correction = (int16_t) reference_true[reference_count - 1] - (int16_t) reference_raw[reference_count - 1];
+        }
+        else if (reference_raw[j] == reference_raw[j + 1])
+        {
+            // Use the first of references with the same raw position.
+            correction = (int16_t) reference_true[j] - (int16_t) reference_raw[j];
+        }
+        else
+        {
+            int16_t correction_0 = (int16_t) reference_true[j] - (int16_t) reference_raw[j];
+            int16_t correction_1 = (int16_t) reference_true[j + 1] - (int16_t) reference_raw[j + 1];
+
+            // Interpolate the correction between the references.
+            correction = correction_0 + (int16_t) (((int32_t) (correction_1 - correction_0) * (raw - (int16_t) reference_raw[j])) /
+                                                   ((int16_t) reference_raw[j + 1] - (int16_t) reference_raw[j]));
+        }
+
+        // Keep the correction within the range of a table point.
+        if (correction > MAX_CORRECTION) correction = MAX_CORRECTION;
+        if (correction < -MAX_CORRECTION) correction = -MAX_CORRECTION;
+
+        banks_write_byte(BANK_LINEAR, REG_LINEAR_POINT_0 + i, (uint8_t) correction);
+    }
+
+    // Enable the table.
+    banks_write_byte(BANK_LINEAR, REG_LINEAR_ENABLE, 1);
+    banks_write_byte(BANK_STATUS, REG_LINEAR_STATUS, reference_count);
+}
+
+#endif // LINEAR_ENABLED
@@ -0,0 +1,60 @@
+/*
+    Copyright (c) 2006 Michael P. Thompson <mpthompson@gmail.com>
+
+    Permission is hereby granted, free of charge, to any person 
+    obtaining a copy of this software and associated documentation 
+    files (the "Software"), to deal in the Software without 
+    restriction, including without limitation the rights to use, copy, 
+    modify, merge, publish, distribute, sublicense, and/or sell copies 
+    of the Software, and to permit persons to whom the Software is 
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be 
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+
+    $Id$
+*/
+
+#ifndef _OS_LINEAR_H_
+#define _OS_LINEAR_H_ 1
+
+// Number of points in the linearization table.  The points are spaced
+// every 64 position units from 0 to 1024.
+#define LINEAR_POINTS           17
+#define LINEAR_POINT_SHIFT      6
+
+// Maximum number of reference points recorded by a calibration.
+#define LINEAR_MAX_REFERENCES   16
+
+// Calibration status reported in REG_LINEAR_STATUS on failure.
+#define LINEAR_STATUS_FAILED    0xFF
+
+// Initialize the linearization module.
+void linear_init(void);
+
+// Initialize the linearization related register values.
+void linear_registers_defaults(void);
+
+// Take the raw position with shift extra bits of resolution and return the
+// linearized position with the same resolution.
+uint16_t linear_correct(uint16_t position, uint8_t shift);
+
+// Start a calibration by clearing the recorded reference points.
+void linear_calibrate_start(void);
+
+// Record the last raw position against the host supplied reference position.
+void linear_calibrate_point(void);
+
+// Fill the linearization table from the recorded reference points.
+void linear_calibrate_finish(void);
+
+#endif // _OS_LINEAR_H_
@@ -31,9 +31,18 @@
 #include "openservo.h"
 #include "config.h"
 #include "adc.h"
+#include "autotune.h"
+#include "cascade.h"
+#include "controller.h"
 #include "eeprom.h"
+#include "friction.h"
+#include "voltage.h"
+#include "bemf.h"
+#include "slew.h"
 #include "estimator.h"
+#include "fifo.h"
 #include "ipd.h"
+#include "linear.h"
 #include "motion.h"
 #include "pid.h"
 #include "regulator.h"
@@ -119,6 +128,9 @@ static void handle_twi_command(void)
 
         case TWI_CMD_REGISTERS_SAVE:
 
+            // Save the gains of the running controller to its slot.
+            controller_registers_save();
+
             // Save register values into EEPROM.
             eeprom_save_registers();
 
@@ -129,6 +141,9 @@ static void handle_twi_command(void)
             // Restore register values into EEPROM.
             eeprom_restore_registers();
 
+            // Switch to the restored controller without touching its slots.
+            controller_registers_restore();
+
             break;
 
         case TWI_CMD_REGISTERS_DEFAULT:
@@ -181,6 +196,56 @@ static void handle_twi_command(void)
             break;
 #endif
 
+#if ADC_HEALTH_ENABLED
+        case TWI_CMD_HEALTH_RESET:
+
+            // Reset the ADC pipeline health counters.
+            adc_health_reset();
+
+            break;
+#endif
+
+#if FIFO_ENABLED
+        case TWI_CMD_FIFO_RESET:
+
+            // Empty the ADC sample FIFO.
+            fifo_reset();
+
+            break;
+#endif
+
+#if LINEAR_ENABLED
+        case TWI_CMD_LINEAR_START:
+
+            // Start a position linearization calibration.
+            linear_calibrate_start();
+
+            break;
+
+        case TWI_CMD_LINEAR_POINT:
+
+            // Record a position linearization reference point.
+            linear_calibrate_point();
+
+            break;
+
+        case TWI_CMD_LINEAR_FINISH:
+
+            // Fill the position linearization table.
+            linear_calibrate_finish();
+
+            break;
+#endif
+
+#if AUTOTUNE_ENABLED
+        case TWI_CMD_AUTOTUNE:
+
+            // Start the relay feedback autotune.
+            autotune_start();
+
+            break;
+#endif
+
         default:
 
             // Ignore unknown command.
@@ -211,19 +276,42 @@ int main (void)
     estimator_init();
 #endif
 
-#if REGULATOR_MOTION_ENABLED
-    // Initialize the regulator algorithm module.
-    regulator_init();
+    // Initialize the controller module and motion control algorithms.
+    controller_init();
+
+#if LINEAR_ENABLED
+    // Initialize the position linearization module.
+    linear_init();
+#endif
+
+#if FIFO_ENABLED
+    // Initialize the ADC sample FIFO module.
+    fifo_init();
+#endif
+
+#if FRICTION_ENABLED
+    // Initialize the friction compensation module.
+    friction_init();
+#endif
+
+#if VOLTAGE_COMP_ENABLED
+    // Initialize the supply voltage compensation module.
+    voltage_init();
+#endif
+
+#if BEMF_ENABLED
+    // Initialize the back-EMF velocity module.
+    bemf_init();
 #endif
 
-#if PID_MOTION_ENABLED
-    // Initialize the PID algorithm module.
-    pid_init();
+#if SLEW_ENABLED
+    // Initialize the output slew rate limiter module.
+    slew_init();
 #endif
 
-#if IPD_MOTION_ENABLED
-    // Initialize the IPD algorithm module.
-    ipd_init();
+#if AUTOTUNE_ENABLED
+    // Initialize the autotune module.
+    autotune_init();
 #endif
 
 #if CURVE_MOTION_ENABLED
@@ -282,35 +370,82 @@ int main (void)
 
 #if CURVE_MOTION_ENABLED
             // Give the motion curve a chance to update the seek position and velocity.
-            motion_next(10);
+            motion_next(adc_get_sample_period());
 #endif
 
             // Get the new position value.
             position = (int16_t) adc_get_position_value();
 
+#if ADC_HEALTH_ENABLED
+            // Update the ADC pipeline health registers.
+            adc_health_update();
+#endif
+
+#if ADC_TIMER2
+            // Report the sample timebase latency and jitter.
+            banks_write_byte(BANK_STATUS, REG_SAMPLE_LATENCY, adc_get_sample_latency());
+            banks_write_byte(BANK_STATUS, REG_SAMPLE_JITTER, adc_get_sample_jitter());
+#endif
+
+#if LINEAR_ENABLED
+            // Linearize the position.
+            position = (int16_t) linear_correct((uint16_t) position, 0);
+#endif
+
+#if ADC_OVERSAMPLE_ENABLED
+            {
+                // Report the high resolution position using the seek sense.
+                uint16_t position_hires = adc_get_position_hires();
+#if LINEAR_ENABLED
+                position_hires = linear_correct(position_hires, ADC_POSITION_SHIFT);
+#endif
+                if (pwm_is_reverse_seek())
+                    position_hires = (1023 << ADC_POSITION_SHIFT) - position_hires;
+                banks_write_word(BANK_STATUS, REG_POSITION_HIRES_HI, REG_POSITION_HIRES_LO, position_hires);
+            }
+#endif
+
+#if ADC_MEDIAN_ENABLED
+            // Report the count of position spikes rejected by the median prefilter.
+            banks_write_word(BANK_STATUS, REG_POSITION_OUTLIERS_HI, REG_POSITION_OUTLIERS_LO, adc_get_position_outliers());
+#endif
+
 #if ESTIMATOR_ENABLED
             // Estimate velocity.
             estimate_velocity(position);
 #endif
 
-#if PID_MOTION_ENABLED
-            // Call the PID algorithm module to get a new PWM value.
-            pwm = pid_position_to_pwm(position);
+            // Call the selected motion control algorithm to get a new PWM value.
+            pwm = controller_position_to_pwm(position);
+
+#if FRICTION_ENABLED
+            // Compensate the PWM value for friction and stiction.
+            pwm = friction_compensate(controller_get_error(), controller_get_velocity(), pwm);
 #endif
 
-#if IPD_MOTION_ENABLED
-            // Call the IPD algorithm module to get a new PWM value.
-            pwm = ipd_position_to_pwm(position);
+#if AUTOTUNE_ENABLED
+            // A running autotune overrides the motion control output.
+            if (autotune_is_running()) pwm = autotune_position_to_pwm(position);
 #endif
 
-#if REGULATOR_MOTION_ENABLED
-            // Call the state regulator algorithm module to get a new PWM value.
-            pwm = regulator_position_to_pwm(position);
+#if VOLTAGE_COMP_ENABLED
+            // Compensate the PWM value for the supply voltage.
+            pwm = voltage_compensate(pwm);
+#endif
+
+#if SLEW_ENABLED
+            // Limit how fast the PWM value changes.
+            pwm = slew_limit(pwm);
 #endif
 
             // Update the servo movement as indicated by the PWM value.
             // Sanity checks are performed against the position value.
             pwm_update(position, pwm);
+
+#if ADC_SAMPLE_PERIOD_ENABLED
+            // Reprogram the sample timer if the sample period changed.
+            adc_sample_period_update();
+#endif
         }
 
         // Is a power value ready?
@@ -321,13 +456,39 @@ int main (void)
 
             // Update the power value for reporting.
             power_update(power);
+
+#if CASCADE_MOTION_ENABLED
+            // Close the cascade current loop on the new power value.
+            cascade_current_update(power);
+#endif
         }
 
+#if ADC_SCHEDULE
+        // Is a supply voltage value ready?
+        if (adc_voltage_value_is_ready())
+        {
+            // Save the supply voltage value to the registers.
+            registers_write_word(REG_VOLTAGE_HI, REG_VOLTAGE_LO, adc_get_voltage_value());
+        }
+
+#if BEMF_ENABLED
+        // Is a back-EMF value ready?
+        if (adc_bemf_value_is_ready())
+        {
+            // Convert the back-EMF value to a velocity.
+            bemf_update(adc_get_bemf_value());
+        }
+#endif
+#endif
+
         // Was a command recieved?
         if (twi_data_in_receive_buffer())
         {
             // Handle any TWI command.
             handle_twi_command();
+
+            // The command may have changed the upper registers.
+            registers_changed();
         }
 
 #if MAIN_MOTION_TEST_ENABLED
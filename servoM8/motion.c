@@ -214,9 +214,16 @@ void motion_next(uint16_t delta)
 {
     float fposition;
     float fvelocity;
+    float facceleration;
 
     // Determine if curve motion is disabled in the registers.
-    if (!(registers_read_byte(REG_FLAGS_LO) & (1<<FLAGS_LO_MOTION_ENABLED))) return;
+    if (!(registers_read_byte(REG_FLAGS_LO) & (1<<FLAGS_LO_MOTION_ENABLED)))
+    {
+        // There is no acceleration to feed forward without a curve.
+        banks_write_word(BANK_STATUS, REG_SEEK_ACCELERATION_HI, REG_SEEK_ACCELERATION_LO, 0);
+
+        return;
+    }
 
     // Are we processing an empty curve?
     if (motion_tail == motion_head)
@@ -273,19 +280,33 @@ void motion_next(uint16_t delta)
         }
     }
 
-    // Get the position and velocity from the hermite curve.
-    curve_solve(motion_counter, &fposition, &fvelocity);
+    // Get the position, velocity and acceleration from the hermite curve.
+    curve_solve(motion_counter, &fposition, &fvelocity, &facceleration);
 
     // The velocity is in position units a millisecond, but we really need the
     // velocity to be measured in position units every 10 milliseconds to match
     // the sample period of the ADC.
     fvelocity *= 10.0;
 
+    // Likewise the acceleration is converted to position units every 10
+    // milliseconds squared.  It is also scaled by 256 to keep it as an 8:8
+    // fixed point value as the acceleration is typically much less than one.
+    facceleration *= 100.0 * 256.0;
+
+    // A short curve can accelerate by more than 128 position units every 10
+    // milliseconds squared which doesn't fit in 8:8 fixed point.  Limit the
+    // acceleration rather than let it wrap around to the opposite sign.
+    if (facceleration > 32767.0) facceleration = 32767.0;
+    if (facceleration < -32767.0) facceleration = -32767.0;
+
     // Update the seek position register.
     registers_write_word(REG_SEEK_POSITION_HI, REG_SEEK_POSITION_LO, float_to_int(fposition));
 
     // Update the seek velocity register.
     registers_write_word(REG_SEEK_VELOCITY_HI, REG_SEEK_VELOCITY_LO, float_to_int(fvelocity));
+
+    // Update the seek acceleration register.
+    banks_write_word(BANK_STATUS, REG_SEEK_ACCELERATION_HI, REG_SEEK_ACCELERATION_LO, float_to_int(facceleration));
 }
 
 
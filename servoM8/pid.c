@@ -28,7 +28,13 @@
 
 #include "openservo.h"
 #include "config.h"
+#include "adc.h"
+#include "bemf.h"
+#include "controller.h"
+#include "filter.h"
+#include "linear.h"
 #include "pid.h"
+#include "pwm.h"
 #include "registers.h"
 
 // The minimum and maximum servo position as defined by 10-bit ADC values.
@@ -36,12 +42,51 @@
 #define MAX_POSITION            (1023)
 
 // The minimum and maximum output.
-#define MAX_OUTPUT              (255)
+#define MAX_OUTPUT              (MAX_PWM_OUTPUT)
 #define MIN_OUTPUT              (-MAX_OUTPUT)
 
+// The integral accumulator is kept with 16 bits of fraction so that small
+// integral gains can still accumulate a steady state correction.  The
+// accumulator is clamped so that its contribution alone can never exceed
+// the output range of the PID algorithm.
+#define MAX_INTEGRAL            ((int32_t) MAX_OUTPUT << (16 - PWM_OUTPUT_SHIFT))
+#define MIN_INTEGRAL            (-MAX_INTEGRAL)
+
+// A change of the seek position by more than this many position units
+// in a single sample is treated as a jump which resets the integrator.
+#define INTEGRAL_RESET_JUMP     (8)
+
 // Values preserved across multiple PID iterations.
 static int16_t previous_seek;
 static int16_t previous_position;
+static int32_t integral_accumulator;
+
+// Parameters decoded from the registers.  These are only refreshed when
+// the register write count shows the registers have changed so that the
+// registers aren't read with interrupts disabled on every iteration.  In
+// the avr-gcc listing of the original build (Debug/servoM8.lss) each
+// registers_read_word() call costs 28 cycles against 4 for loading a
+// cached word, so the seven cached words save about 160 cycles a sample.
+// The filter and gain schedule bytes are cached along with them.  The only
+// registers still read every sample are the seek position, velocity and
+// acceleration, which the motion profile and host change at any time, and
+// the PWM enabled flag.
+static uint8_t parameters_write_count;
+static uint8_t parameters_reverse_seek;
+static int16_t parameters_deadband;
+static int16_t parameters_minimum_position;
+static int16_t parameters_maximum_position;
+static uint16_t parameters_p_gain;
+static uint16_t parameters_d_gain;
+static uint16_t parameters_i_gain;
+static uint16_t parameters_vff_gain;
+static uint16_t parameters_aff_gain;
+#if FILTER_ENABLED
+static uint8_t parameters_position_filter_type;
+static uint8_t parameters_position_filter_coeff;
+static uint8_t parameters_velocity_filter_type;
+static uint8_t parameters_velocity_filter_coeff;
+#endif
 
 //
 // Digital Lowpass Filter Implementation
@@ -60,6 +105,15 @@ static int16_t previous_position;
 // 8    0.0007                          561
 //
 
+#if FILTER_ENABLED
+
+// The position and derivative paths are filtered separately by the
+// configurable filters in the filter.c module.
+static filter_state position_filter;
+static filter_state velocity_filter;
+
+#else
+
 #define FILTER_SHIFT 1
 
 static int32_t filter_reg = 0;
@@ -73,12 +127,146 @@ static int16_t filter_update(int16_t input)
     return (int16_t) (filter_reg >> FILTER_SHIFT);
 }
 
+#endif // FILTER_ENABLED
+
+#if PID_GAIN_SCHEDULE_ENABLED
+
+//
+// Gain Schedule Implementation
+//
+// The gain schedule scales the proportional and derivative gains by
+// 2:6 fixed point factors (0x40 is a factor of one).  The factors are
+// held in tables of five points which are linearly interpolated.  The
+// error tables have points at absolute position errors of 0, 1, 2, 3
+// and 4 times (1 << REG_GAIN_SCHEDULE_SHIFT).  The zone table has points
+// at positions 0, 256, 512, 768 and 1024 and scales both gains.  The
+// point spacing is a power of two so no division is needed.
+//
+
+#define GAIN_SCHEDULE_POINTS    5
+#define GAIN_SCHEDULE_UNITY     0x40
+#define GAIN_ZONE_SHIFT         8
+
+// Gain schedule registers cached with the other parameters.
+static uint8_t parameters_schedule_flags;
+static uint8_t parameters_schedule_shift;
+static uint8_t parameters_schedule_p[GAIN_SCHEDULE_POINTS];
+static uint8_t parameters_schedule_d[GAIN_SCHEDULE_POINTS];
+static uint8_t parameters_schedule_zone[GAIN_SCHEDULE_POINTS];
+
+static uint8_t gain_schedule_interpolate(const uint8_t *table, uint16_t value, uint8_t shift)
+// Interpolate the cached table of scale factors for the value.  Table
+// points are 1 << shift apart.
+{
+    uint16_t index;
+    int16_t lower;
+    int16_t upper;
+
+    // Determine the table index and clamp past the last point.
+    index = value >> shift;
+    if (index >= (GAIN_SCHEDULE_POINTS - 1)) return table[GAIN_SCHEDULE_POINTS - 1];
+
+    // Get the table points to either side of the value.
+    lower = table[index];
+    upper = table[index + 1];
+
+    // Interpolate between the points using the remainder of the value.
+    return (uint8_t) (lower + (int16_t) ((((int32_t) (upper - lower)) * (value & ((1 << shift) - 1))) >> shift));
+}
+
+
+static uint16_t gain_schedule_apply(uint16_t gain, uint8_t scale)
+// Scale the 8:8 fixed point gain by the 2:6 fixed point scale factor.
+{
+    uint32_t scaled_gain = ((uint32_t) gain * scale) >> 6;
+
+    // Saturate the gain.
+    return scaled_gain > 0xFFFF ? 0xFFFF : (uint16_t) scaled_gain;
+}
+
+#endif // PID_GAIN_SCHEDULE_ENABLED
+
+static int16_t pid_coarse(int16_t value)
+// Reduce a high resolution position value to 10-bit position units
+// rounding towards zero so that positive and negative values match.
+{
+    if (value < 0) return -((-value) >> ADC_POSITION_SHIFT);
+    return value >> ADC_POSITION_SHIFT;
+}
+
+
+static void pid_parameters_refresh(void)
+// Refresh the decoded parameters if the registers have changed.
+{
+    // Have the registers changed since the parameters were decoded?
+    if (parameters_write_count == registers_get_write_count()) return;
+
+    // Remember the count before reading so that a write during the
+    // refresh causes another refresh.
+    parameters_write_count = registers_get_write_count();
+
+    // Get the deadband.
+    parameters_deadband = (int16_t) registers_read_byte(REG_PID_DEADBAND);
+
+    // Get the minimum and maximum position.
+    parameters_reverse_seek = registers_read_byte(REG_REVERSE_SEEK);
+    parameters_minimum_position = (int16_t) registers_read_word(REG_MIN_SEEK_HI, REG_MIN_SEEK_LO);
+    parameters_maximum_position = (int16_t) registers_read_word(REG_MAX_SEEK_HI, REG_MAX_SEEK_LO);
+
+    // Reverse sense the position limits.
+    if (parameters_reverse_seek != 0)
+    {
+        parameters_minimum_position = MAX_POSITION - parameters_minimum_position;
+        parameters_maximum_position = MAX_POSITION - parameters_maximum_position;
+    }
+
+    // Get the proportional, derivative and integral gains.
+    parameters_p_gain = registers_read_word(REG_PID_PGAIN_HI, REG_PID_PGAIN_LO);
+    parameters_d_gain = registers_read_word(REG_PID_DGAIN_HI, REG_PID_DGAIN_LO);
+    parameters_i_gain = registers_read_word(REG_PID_IGAIN_HI, REG_PID_IGAIN_LO);
+
+    // Get the velocity and acceleration feedforward gains.
+    parameters_vff_gain = banks_read_word(BANK_CONFIG, REG_PID_VFF_GAIN_HI, REG_PID_VFF_GAIN_LO);
+    parameters_aff_gain = banks_read_word(BANK_CONFIG, REG_PID_AFF_GAIN_HI, REG_PID_AFF_GAIN_LO);
+
+#if FILTER_ENABLED
+    // Get the position and derivative path filters.
+    parameters_position_filter_type = banks_read_byte(BANK_CONFIG, REG_FILTER_POSITION_TYPE);
+    parameters_position_filter_coeff = banks_read_byte(BANK_CONFIG, REG_FILTER_POSITION_COEFF);
+    parameters_velocity_filter_type = banks_read_byte(BANK_CONFIG, REG_FILTER_VELOCITY_TYPE);
+    parameters_velocity_filter_coeff = banks_read_byte(BANK_CONFIG, REG_FILTER_VELOCITY_COEFF);
+#endif
+
+#if PID_GAIN_SCHEDULE_ENABLED
+    {
+        uint8_t i;
+
+        // Get the gain schedule flags, error point spacing and tables.
+        parameters_schedule_flags = banks_read_byte(BANK_GAINS, REG_GAIN_SCHEDULE_FLAGS);
+        parameters_schedule_shift = banks_read_byte(BANK_GAINS, REG_GAIN_SCHEDULE_SHIFT) & 0x07;
+        for (i = 0; i < GAIN_SCHEDULE_POINTS; ++i)
+        {
+            parameters_schedule_p[i] = banks_read_byte(BANK_GAINS, REG_GAIN_SCHEDULE_P0 + i);
+            parameters_schedule_d[i] = banks_read_byte(BANK_GAINS, REG_GAIN_SCHEDULE_D0 + i);
+            parameters_schedule_zone[i] = banks_read_byte(BANK_GAINS, REG_GAIN_ZONE_0 + i);
+        }
+    }
+#endif
+}
+
+
 void pid_init(void)
 // Initialize the PID algorithm module.
 {
     // Initialize preserved values.
     previous_seek = 0;
     previous_position = 0;
+
+    // Initialize the integral accumulator.
+    integral_accumulator = 0;
+
+    // Force the parameters to be refreshed.
+    parameters_write_count = registers_get_write_count() - 1;
 }
 
 
@@ -94,6 +282,34 @@ void pid_registers_defaults(void)
     registers_write_word(REG_PID_DGAIN_HI, REG_PID_DGAIN_LO, DEFAULT_PID_DGAIN);
     registers_write_word(REG_PID_IGAIN_HI, REG_PID_IGAIN_LO, DEFAULT_PID_IGAIN);
 
+    // Default feedforward gain values.
+    banks_write_word(BANK_CONFIG, REG_PID_VFF_GAIN_HI, REG_PID_VFF_GAIN_LO, DEFAULT_PID_VFF_GAIN);
+    banks_write_word(BANK_CONFIG, REG_PID_AFF_GAIN_HI, REG_PID_AFF_GAIN_LO, DEFAULT_PID_AFF_GAIN);
+
+#if FILTER_ENABLED
+    // Default position and derivative path filters.
+    banks_write_byte(BANK_CONFIG, REG_FILTER_POSITION_TYPE, DEFAULT_FILTER_POSITION_TYPE);
+    banks_write_byte(BANK_CONFIG, REG_FILTER_POSITION_COEFF, DEFAULT_FILTER_POSITION_COEFF);
+    banks_write_byte(BANK_CONFIG, REG_FILTER_VELOCITY_TYPE, DEFAULT_FILTER_VELOCITY_TYPE);
+    banks_write_byte(BANK_CONFIG, REG_FILTER_VELOCITY_COEFF, DEFAULT_FILTER_VELOCITY_COEFF);
+#endif
+
+#if PID_GAIN_SCHEDULE_ENABLED
+    {
+        uint8_t i;
+
+        // Default gain schedule is disabled with unity scale factors.
+        banks_write_byte(BANK_GAINS, REG_GAIN_SCHEDULE_FLAGS, 0x00);
+        banks_write_byte(BANK_GAINS, REG_GAIN_SCHEDULE_SHIFT, 0x04);
+        for (i = 0; i < GAIN_SCHEDULE_POINTS; ++i)
+        {
+            banks_write_byte(BANK_GAINS, REG_GAIN_SCHEDULE_P0 + i, GAIN_SCHEDULE_UNITY);
+            banks_write_byte(BANK_GAINS, REG_GAIN_SCHEDULE_D0 + i, GAIN_SCHEDULE_UNITY);
+            banks_write_byte(BANK_GAINS, REG_GAIN_ZONE_0 + i, GAIN_SCHEDULE_UNITY);
+        }
+    }
+#endif
+
     // Default position limits.
     registers_write_word(REG_MIN_SEEK_HI, REG_MIN_SEEK_LO, DEFAULT_MIN_SEEK);
     registers_write_word(REG_MAX_SEEK_HI, REG_MAX_SEEK_LO, DEFAULT_MAX_SEEK);
@@ -110,72 +326,162 @@ int16_t pid_position_to_pwm(int16_t current_position)
 {
     // We declare these static to keep them off the stack.
     static int16_t deadband;
+    static int16_t seek_jump;
     static int16_t p_component;
+    static int16_t p_fine;
     static int16_t d_component;
     static int16_t seek_position;
     static int16_t seek_velocity;
+    static int16_t seek_acceleration;
     static int16_t minimum_position;
     static int16_t maximum_position;
     static int16_t current_velocity;
     static int16_t filtered_position;
+    static int16_t fine_position;
     static int32_t pwm_output;
     static uint16_t d_gain;
     static uint16_t p_gain;
 
+#if ADC_OVERSAMPLE_ENABLED
+    // Control with the high resolution position.  This has ADC_POSITION_SHIFT
+    // more bits of resolution than the 10-bit position which gives a smoother
+    // velocity and finer positioning.
+    fine_position = (int16_t) adc_get_position_hires();
+#if LINEAR_ENABLED
+    fine_position = (int16_t) linear_correct((uint16_t) fine_position, ADC_POSITION_SHIFT);
+#endif
+#else
+    fine_position = current_position;
+#endif
+
+    // Refresh the parameters if the registers have changed.
+    pid_parameters_refresh();
+
+#if FILTER_ENABLED
+    // Filter the current position thru the position path filter.
+    filtered_position = filter_state_update(&position_filter,
+                                            parameters_position_filter_type,
+                                            parameters_position_filter_coeff,
+                                            fine_position);
+
+    // Filter the change in position thru the derivative path filter to
+    // determine velocity.
+    current_velocity = filter_state_update(&velocity_filter,
+                                           parameters_velocity_filter_type,
+                                           parameters_velocity_filter_coeff,
+                                           fine_position - previous_position);
+    previous_position = fine_position;
+#else
     // Filter the current position thru a digital low-pass filter.
-    filtered_position = filter_update(current_position);
+    filtered_position = filter_update(fine_position);
 
     // Use the filtered position to determine velocity.
     current_velocity = filtered_position - previous_position;
     previous_position = filtered_position;
+#endif
 
-    // Get the seek position and velocity.
+    // Scale the velocity to position units every 10 milliseconds to match
+    // the seek velocity regardless of the sample period.
+    current_velocity *= adc_get_sample_ticks();
+
+#if BEMF_ENABLED
+    // Use the measured back-EMF velocity instead when selected.
+    if (bemf_velocity_is_selected()) current_velocity = bemf_get_velocity() << ADC_POSITION_SHIFT;
+#endif
+
+    // Get the seek position, velocity and acceleration.
     seek_position = (int16_t) registers_read_word(REG_SEEK_POSITION_HI, REG_SEEK_POSITION_LO);
     seek_velocity = (int16_t) registers_read_word(REG_SEEK_VELOCITY_HI, REG_SEEK_VELOCITY_LO);
+    seek_acceleration = (int16_t) banks_read_word(BANK_STATUS, REG_SEEK_ACCELERATION_HI, REG_SEEK_ACCELERATION_LO);
 
     // Get the minimum and maximum position.
-    minimum_position = (int16_t) registers_read_word(REG_MIN_SEEK_HI, REG_MIN_SEEK_LO);
-    maximum_position = (int16_t) registers_read_word(REG_MAX_SEEK_HI, REG_MAX_SEEK_LO);
+    minimum_position = parameters_minimum_position;
+    maximum_position = parameters_maximum_position;
 
     // Are we reversing the seek sense?
-    if (registers_read_byte(REG_REVERSE_SEEK) != 0)
+    if (parameters_reverse_seek != 0)
     {
         // Yes. Update the position and velocity using reverse sense.
         registers_write_word(REG_POSITION_HI, REG_POSITION_LO, (uint16_t) (MAX_POSITION - current_position));
-        registers_write_word(REG_VELOCITY_HI, REG_VELOCITY_LO, (uint16_t) -current_velocity);
+        registers_write_word(REG_VELOCITY_HI, REG_VELOCITY_LO, (uint16_t) -pid_coarse(current_velocity));
 
-        // Reverse sense the seek and other position values.
+        // Reverse sense the seek position.  The position limits were
+        // reverse sensed when the parameters were refreshed.
         seek_position = MAX_POSITION - seek_position;
-        minimum_position = MAX_POSITION - minimum_position;
-        maximum_position = MAX_POSITION - maximum_position;
+
+        // Reverse sense the seek velocity and acceleration.
+        seek_velocity = -seek_velocity;
+        seek_acceleration = -seek_acceleration;
     }
     else
     {
         // No. Update the position and velocity registers without change.
         registers_write_word(REG_POSITION_HI, REG_POSITION_LO, (uint16_t) current_position);
-        registers_write_word(REG_VELOCITY_HI, REG_VELOCITY_LO, (uint16_t) current_velocity);
+        registers_write_word(REG_VELOCITY_HI, REG_VELOCITY_LO, (uint16_t) pid_coarse(current_velocity));
     }
 
     // Get the deadband.
-    deadband = (int16_t) registers_read_byte(REG_PID_DEADBAND);
+    deadband = parameters_deadband;
+
+    // Determine how far the seek position moved since the last sample.
+    seek_jump = seek_position - previous_seek;
 
     // Use the filtered position when the seek position is not changing.
-    if (seek_position == previous_seek) current_position = filtered_position;
+    if (seek_position == previous_seek) fine_position = filtered_position;
     previous_seek = seek_position;
 
+    // Reset the integral accumulator when the seek position jumps to a new
+    // target or when PWM is disabled.  Error accumulated towards the old
+    // target or while the motor could not respond would otherwise cause
+    // a large overshoot.
+    if ((seek_jump > INTEGRAL_RESET_JUMP) || (seek_jump < -INTEGRAL_RESET_JUMP) ||
+        !(registers_read_byte(REG_FLAGS_LO) & (1<<FLAGS_LO_PWM_ENABLED)))
+    {
+        integral_accumulator = 0;
+    }
+
     // Keep the seek position bound within the minimum and maximum position.
     if (seek_position < minimum_position) seek_position = minimum_position;
     if (seek_position > maximum_position) seek_position = maximum_position;
 
-    // The proportional component to the PID is the position error.
-    p_component = seek_position - current_position;
+    // The proportional component to the PID is the position error.  The
+    // deadband and integral use the error in 10-bit position units.
+    p_fine = (seek_position << ADC_POSITION_SHIFT) - fine_position;
+    p_component = pid_coarse(p_fine);
+
+#if FRICTION_ENABLED
+    // Report the error and velocity to the friction compensation.
+    controller_set_motion(p_component, pid_coarse(current_velocity));
+#endif
 
     // The derivative component to the PID is the velocity.
-    d_component = seek_velocity - current_velocity;
+    d_component = (seek_velocity << ADC_POSITION_SHIFT) - current_velocity;
 
-    // Get the proportional, derivative and integral gains.
-    p_gain = registers_read_word(REG_PID_PGAIN_HI, REG_PID_PGAIN_LO);
-    d_gain = registers_read_word(REG_PID_DGAIN_HI, REG_PID_DGAIN_LO);
+    // Get the proportional and derivative gains.
+    p_gain = parameters_p_gain;
+    d_gain = parameters_d_gain;
+
+#if PID_GAIN_SCHEDULE_ENABLED
+    {
+        // Scale the gains according to the absolute position error.
+        if (parameters_schedule_flags & (1<<GAIN_SCHEDULE_ERROR_ENABLED))
+        {
+            uint16_t error = (uint16_t) (p_component < 0 ? -p_component : p_component);
+
+            p_gain = gain_schedule_apply(p_gain, gain_schedule_interpolate(parameters_schedule_p, error, parameters_schedule_shift));
+            d_gain = gain_schedule_apply(d_gain, gain_schedule_interpolate(parameters_schedule_d, error, parameters_schedule_shift));
+        }
+
+        // Scale the gains according to the position zone.
+        if (parameters_schedule_flags & (1<<GAIN_SCHEDULE_ZONE_ENABLED))
+        {
+            uint8_t scale = gain_schedule_interpolate(parameters_schedule_zone, (uint16_t) current_position, GAIN_ZONE_SHIFT);
+
+            p_gain = gain_schedule_apply(p_gain, scale);
+            d_gain = gain_schedule_apply(d_gain, scale);
+        }
+    }
+#endif
 
     // Start with zero PWM output.
     pwm_output = 0;
@@ -184,14 +490,49 @@ int16_t pid_position_to_pwm(int16_t current_position)
     if ((p_component > deadband) || (p_component < -deadband))
     {
         // Apply the proportional component of the PWM output.
-        pwm_output += (int32_t) p_component * (int32_t) p_gain;
+        pwm_output += (int32_t) p_fine * (int32_t) p_gain;
     }
 
     // Apply the derivative component of the PWM output.
     pwm_output += (int32_t) d_component * (int32_t) d_gain;
 
-    // Shift by 8 to account for the multiply by the 8:8 fixed point gain values.
-    pwm_output >>= 8;
+    // Shift out the extra resolution of the proportional and derivative components.
+    pwm_output >>= ADC_POSITION_SHIFT;
+
+    // Apply the velocity feedforward component of the PWM output.  This drives
+    // the motor at the speed the seek position is moving without first waiting
+    // for a position error to build up.
+    pwm_output += (int32_t) seek_velocity * (int32_t) parameters_vff_gain;
+
+    // Apply the acceleration feedforward component of the PWM output.  The
+    // seek acceleration is an 8:8 fixed point value so the product is shifted
+    // by 8 to match the scale of the other components.
+    pwm_output += ((int32_t) seek_acceleration * (int32_t) parameters_aff_gain) >> 8;
+
+    // Shift by 8 to account for the multiply by the 8:8 fixed point gain values
+    // keeping the extra bits of the PWM output resolution.
+    pwm_output >>= 8 - PWM_OUTPUT_SHIFT;
+
+    // Integrate the position error if outside the deadband.  To prevent
+    // integrator windup the error is only integrated when the output is
+    // not already saturated in the direction the error would push it.
+    if ((p_component > deadband) && ((pwm_output + (integral_accumulator >> (16 - PWM_OUTPUT_SHIFT))) < MAX_OUTPUT))
+    {
+        integral_accumulator += (int32_t) p_component * (int32_t) parameters_i_gain;
+    }
+    else if ((p_component < -deadband) && ((pwm_output + (integral_accumulator >> (16 - PWM_OUTPUT_SHIFT))) > MIN_OUTPUT))
+    {
+        integral_accumulator += (int32_t) p_component * (int32_t) parameters_i_gain;
+    }
+
+    // Clamp the integral accumulator to the output range.
+    if (integral_accumulator > MAX_INTEGRAL) integral_accumulator = MAX_INTEGRAL;
+    if (integral_accumulator < MIN_INTEGRAL) integral_accumulator = MIN_INTEGRAL;
+
+    // Apply the integral component of the PWM output.  The integral gain
+    // is a 0:16 fixed point value so the upper word of the accumulator is used
+    // along with the extra bits of the PWM output resolution.
+    pwm_output += integral_accumulator >> (16 - PWM_OUTPUT_SHIFT);
 
     // Check for output saturation.
     if (pwm_output > MAX_OUTPUT)
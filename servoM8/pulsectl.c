@@ -151,8 +151,9 @@ void pulse_control_update(void)
                 registers_write_word(REG_SEEK_POSITION_HI, REG_SEEK_POSITION_LO, pulse_position);
             }
 
-            // The seek velocity will always be zero.
+            // The seek velocity and acceleration will always be zero.
             registers_write_word(REG_SEEK_VELOCITY_HI, REG_SEEK_VELOCITY_LO, 0);
+            banks_write_word(BANK_STATUS, REG_SEEK_ACCELERATION_HI, REG_SEEK_ACCELERATION_LO, 0);
 
             // Make sure pwm is enabled.
             pwm_enable();
@@ -30,6 +30,7 @@
 
 #include "openservo.h"
 #include "config.h"
+#include "adc.h"
 #include "pwm.h"
 #include "registers.h"
 
@@ -51,15 +52,72 @@
 // Determine the top value for timer/counter1 from the frequency divider.
 #define PWM_TOP_VALUE(div)      ((uint16_t) div << 4) - 1;
 
-// Determines the compare value associated with the duty cycle for timer/counter1.
-#define PWM_OCRN_VALUE(div,pwm) (uint16_t) (((uint32_t) pwm * (((uint32_t) div << 4) - 1)) / 255)
 
 // Flags that indicate PWM output in A and B direction.
-static uint8_t pwm_a;
-static uint8_t pwm_b;
+static uint16_t pwm_a;
+static uint16_t pwm_b;
 
-// Pwm frequency divider value.
+// Pwm frequency divider value and the timer/counter1 top value derived from it.
 static uint16_t pwm_div;
+static uint16_t pwm_top;
+
+// Exported variables.
+uint8_t pwm_reverse_seek;
+
+// Position limits and the register write count they and the seek sense
+// were read at.
+static uint8_t pwm_write_count;
+static uint16_t pwm_min_position;
+static uint16_t pwm_max_position;
+
+#if PWM_BRAKE_ENABLED
+// Duty of the short brake being applied, zero if not braking.
+static uint16_t pwm_braking;
+
+// Drive mode, braking duty and decelerating velocity read from the registers.
+static uint8_t pwm_drive_mode;
+static uint16_t pwm_brake_duty;
+static int16_t pwm_brake_velocity;
+
+// Set while a reversing output is braking a decelerating motor.
+static uint8_t pwm_decelerating;
+#endif
+
+#if PWM_DEADTIME_ENABLED
+// Largest dead time in PWM periods so the overflow count fits in a byte.
+#define PWM_DEADTIME_MAX        253
+
+// Dead time in PWM periods, the periods left before the output pending
+// after a direction change is enabled and the COM bits of that output.
+static uint8_t pwm_deadtime;
+static volatile uint8_t pwm_deadtime_count;
+static uint8_t pwm_deadtime_output;
+#endif
+
+#if BEMF_ENABLED
+// Set while the H-bridge is floated for a back-EMF sample.
+static uint8_t pwm_floating;
+#endif
+
+inline static uint16_t pwm_ocrn_value(uint16_t pwm_duty)
+// Determines the compare value associated with the duty cycle for timer/counter1,
+// which is pwm_duty * pwm_top / MAX_PWM_OUTPUT, without a division.  Duplicating
+// the duty byte scales it by 257 to a 16-bit fraction of 65535 so the compare
+// value is pwm_top * (pwm_duty * 257) / 65535.  The division by 65535 is done as
+// (n + (n >> 16) + 1) >> 16 which gives the same result as the division for
+// every duty and divider value.  A 10-bit duty is scaled to the 16-bit fraction
+// by repeating its upper bits which is within one timer count of the division.
+// The division took 660 to 700 cycles through __muluhisi3 and __udivmodsi4
+// in the original build where this takes about 47 through __umulhisi3.
+{
+#if PWM_WIDE_ENABLED
+    uint32_t n = (uint32_t) pwm_top * (uint16_t) ((pwm_duty << 6) | (pwm_duty >> 4));
+#else
+    uint32_t n = (uint32_t) pwm_top * (uint16_t) ((pwm_duty << 8) | pwm_duty);
+#endif
+
+    return (uint16_t) ((n + (n >> 16) + 1) >> 16);
+}
 
 //
 // The delay_loop function is used to provide a delay. The purpose of the delay is to
@@ -78,21 +136,63 @@ inline static void delay_loop(int n)
     }
 }
 
+#if PWM_DEADTIME_ENABLED
+inline static void pwm_deadtime_start(uint8_t output)
+// Enable the indicated timer/counter1 output from the overflow interrupt
+// once the dead time has passed.  The overflow is at BOTTOM which is the
+// middle of the PWM on time.  The outputs must already be disabled and
+// interrupts must be disabled by the caller.
+{
+    uint8_t count = pwm_deadtime;
+
+    // The first overflow may be only a few clocks away so one more is
+    // counted to leave the outputs off for at least the full dead time.
+    // An overflow already pending may have been before the outputs were
+    // disabled and is counted as well.  The pending flag is left for a
+    // power conversion that may be waiting for it.
+    count += 1;
+    if (TIFR & (1<<TOV1)) count += 1;
+
+    pwm_deadtime_output = output;
+    pwm_deadtime_count = count;
+
+    TIMSK |= (1<<TOIE1);
+}
+#endif
+
+static void pwm_registers_update(void)
+// Save the pwm A and B duty values to the registers.
+{
+    // The 8-bit registers are kept for compatibility.
+    registers_write_byte(REG_PWM_DIRA, (uint8_t) (pwm_a >> PWM_OUTPUT_SHIFT));
+    registers_write_byte(REG_PWM_DIRB, (uint8_t) (pwm_b >> PWM_OUTPUT_SHIFT));
+
+#if PWM_WIDE_ENABLED
+    // The wide registers report the full PWM output resolution.
+    banks_write_word(BANK_STATUS, REG_PWM_WIDE_DIRA_HI, REG_PWM_WIDE_DIRA_LO, pwm_a);
+    banks_write_word(BANK_STATUS, REG_PWM_WIDE_DIRB_HI, REG_PWM_WIDE_DIRB_LO, pwm_b);
+#endif
+}
+
 //
 //
 //
-static void pwm_dir_a(uint8_t pwm_duty)
-// Send PWM signal for rotation with the indicated pwm ratio (0 - 255).
+static void pwm_dir_a(uint16_t pwm_duty)
+// Send PWM signal for rotation with the indicated pwm ratio (0 - MAX_PWM_OUTPUT).
 // This function is meant to be called only by pwm_update.
 {
     // Determine the duty cycle value for the timer.
-    uint16_t duty_cycle = PWM_OCRN_VALUE(pwm_div, pwm_duty);
+    uint16_t duty_cycle = pwm_ocrn_value(pwm_duty);
 
     // Disable interrupts.
     cli();
 
     // Do we need to reconfigure PWM output?
+#if PWM_BRAKE_ENABLED
+    if (!pwm_a || pwm_b || pwm_braking)
+#else
     if (!pwm_a || pwm_b)
+#endif
     {
 
         // Disable PWM_A (PB1/OC1A) and PWM_B (PB2/OC1B) output.
@@ -104,16 +204,29 @@ static void pwm_dir_a(uint8_t pwm_duty)
         // Yes. Make sure PB1 and PB2 are zero.
         PORTB &= ~((1<<PB1) | (1<<PB2));
 
+#if PWM_DEADTIME_ENABLED
+        // Enable PWM_A (PB1/OC1A) output once the H-bridge had the dead
+        // time to respond to the above changes.
+        pwm_deadtime_start(1<<COM1A1);
+#else
         //
         // Give the H-bridge time to respond to the above changes
         //
         delay_loop(DELAYLOOP);
 
+#if BEMF_ENABLED
+        // A floated H-bridge is enabled by pwm_drive().
+        if (!pwm_floating)
+#endif
         // Enable PWM_A (PB1/OC1A)  output.
         TCCR1A |= (1<<COM1A1);
+#endif
 
-        // Reset the B direction flag.
+        // Reset the B direction and brake flags.
         pwm_b = 0;
+#if PWM_BRAKE_ENABLED
+        pwm_braking = 0;
+#endif
     }
 
     // Set the A direction flag.
@@ -127,23 +240,26 @@ static void pwm_dir_a(uint8_t pwm_duty)
     sei();
 
     // Save the pwm A and B duty values.
-    registers_write_byte(REG_PWM_DIRA, pwm_a);
-    registers_write_byte(REG_PWM_DIRB, pwm_b);
+    pwm_registers_update();
 }
 
 
-static void pwm_dir_b(uint8_t pwm_duty)
-// Send PWM signal for rotation with the indicated pwm ratio (0 - 255).
+static void pwm_dir_b(uint16_t pwm_duty)
+// Send PWM signal for rotation with the indicated pwm ratio (0 - MAX_PWM_OUTPUT).
 // This function is meant to be called only by pwm_update.
 {
     // Determine the duty cycle value for the timer.
-    uint16_t duty_cycle = PWM_OCRN_VALUE(pwm_div, pwm_duty);
+    uint16_t duty_cycle = pwm_ocrn_value(pwm_duty);
 
     // Disable interrupts.
     cli();
 
     // Do we need to reconfigure PWM output?
+#if PWM_BRAKE_ENABLED
+    if (!pwm_b || pwm_a || pwm_braking)
+#else
     if (!pwm_b || pwm_a)
+#endif
     {
 
         // Disable PWM_A (PB1/OC1A) and PWM_B (PB2/OC1B) output.
@@ -155,16 +271,29 @@ static void pwm_dir_b(uint8_t pwm_duty)
        // Yes. Make sure PB1 and PB2 are zero.
         PORTB &= ~((1<<PB1) | (1<<PB2));
 
+#if PWM_DEADTIME_ENABLED
+        // Enable PWM_B (PB2/OC1B) output once the H-bridge had the dead
+        // time to respond to the above changes.
+        pwm_deadtime_start(1<<COM1B1);
+#else
         //
         // Give the H-bridge time to respond to the above changes
         //
         delay_loop(DELAYLOOP);
 
+#if BEMF_ENABLED
+        // A floated H-bridge is enabled by pwm_drive().
+        if (!pwm_floating)
+#endif
         // Enable PWM_B (PB2/OC1B) output.
         TCCR1A = (1<<COM1B1);
+#endif
 
-        // Reset the A direction flag.
+        // Reset the A direction and brake flags.
         pwm_a = 0;
+#if PWM_BRAKE_ENABLED
+        pwm_braking = 0;
+#endif
     }
 
     // Set the B direction flag.
@@ -178,11 +307,71 @@ static void pwm_dir_b(uint8_t pwm_duty)
     sei();
 
     // Save the pwm A and B duty values.
-    registers_write_byte(REG_PWM_DIRA, pwm_a);
-    registers_write_byte(REG_PWM_DIRB, pwm_b);
+    pwm_registers_update();
 }
 
 
+#if PWM_BRAKE_ENABLED
+static void pwm_brake(uint16_t pwm_duty)
+// Short the motor through the H-bridge for the indicated pwm ratio (1 - MAX_PWM_OUTPUT)
+// of each period by driving the A and B outputs together.  The motor coasts for
+// the rest of the period.  This is only safe on the half bridge H-bridges allowed
+// by PWM_BRAKE_HALF_BRIDGE.  This function is meant to be called only by pwm_update.
+{
+    // Determine the duty cycle value for the timer.
+    uint16_t duty_cycle = pwm_ocrn_value(pwm_duty);
+
+    // Disable interrupts.
+    cli();
+
+    // Do we need to reconfigure PWM output?
+    if (!pwm_braking)
+    {
+        // Disable PWM_A (PB1/OC1A) and PWM_B (PB2/OC1B) output.
+        TCCR1A &= ~((1<<COM1A1) | (1<<COM1B1));
+
+        // Make sure PB1 and PB2 are zero.
+        PORTB &= ~((1<<PB1) | (1<<PB2));
+
+#if PWM_DEADTIME_ENABLED
+        // Enable both outputs once the H-bridge had the dead time to
+        // respond to the above changes.
+        pwm_deadtime_start((1<<COM1A1) | (1<<COM1B1));
+#else
+        //
+        // Give the H-bridge time to respond to the above changes
+        //
+        delay_loop(DELAYLOOP);
+
+#if BEMF_ENABLED
+        // A floated H-bridge is enabled by pwm_drive().
+        if (!pwm_floating)
+#endif
+        // Enable PWM_A (PB1/OC1A) and PWM_B (PB2/OC1B) output.
+        TCCR1A |= (1<<COM1A1) | (1<<COM1B1);
+#endif
+
+        // Reset the A and B direction flags.
+        pwm_a = 0;
+        pwm_b = 0;
+    }
+
+    // Set the brake flag.
+    pwm_braking = pwm_duty;
+
+    // Update the PWM duty cycle of both outputs.
+    OCR1A = duty_cycle;
+    OCR1B = duty_cycle;
+
+    // Restore interrupts.
+    sei();
+
+    // Save the pwm A and B duty values.
+    pwm_registers_update();
+}
+#endif
+
+
 void pwm_registers_defaults(void)
 // Initialize the PWM algorithm related register values.  This is done 
 // here to keep the PWM related code in a single file.  
@@ -194,14 +383,31 @@ void pwm_registers_defaults(void)
     // RC servo will my typically use a divider value between 16 and 64.  A larger 
     // motor with higher inductance and impedance may require a greater divider.
     registers_write_word(REG_PWM_FREQ_DIVIDER_HI, REG_PWM_FREQ_DIVIDER_LO, DEFAULT_PWM_FREQ_DIVIDER);
+
+#if PWM_DEADTIME_ENABLED
+    // Number of PWM periods the H-bridge is left off when the direction changes.
+    banks_write_byte(BANK_CONFIG, REG_PWM_DEADTIME, DEFAULT_PWM_DEADTIME);
+#endif
+
+#if PWM_BRAKE_ENABLED
+    // Coast or brake when the output is zero and whether to brake while decelerating.
+    banks_write_byte(BANK_CONFIG, REG_PWM_DRIVE_MODE, DEFAULT_PWM_DRIVE_MODE);
+    banks_write_byte(BANK_CONFIG, REG_PWM_BRAKE_DUTY, DEFAULT_PWM_BRAKE_DUTY);
+    banks_write_byte(BANK_CONFIG, REG_PWM_BRAKE_VELOCITY, DEFAULT_PWM_BRAKE_VELOCITY);
+#endif
 }
 
 
 void pwm_init(void)
 // Initialize the PWM module for controlling a DC motor.
 {
-    // Initialize the pwm frequency divider value.
+    // Initialize the pwm frequency divider and top values.
     pwm_div = registers_read_word(REG_PWM_FREQ_DIVIDER_HI, REG_PWM_FREQ_DIVIDER_LO);
+    pwm_top = PWM_TOP_VALUE(pwm_div);
+
+    // Get the seek sense and force it and the position limits to be refreshed.
+    pwm_reverse_seek = registers_read_byte(REG_REVERSE_SEEK);
+    pwm_write_count = registers_get_write_count() - 1;
 
     TCCR1A = 0;
         asm("nop");
@@ -222,7 +428,7 @@ void pwm_init(void)
     TIMSK = 0;
 
     // Set timer top value.
-    ICR1 = PWM_TOP_VALUE(pwm_div);
+    ICR1 = pwm_top;
 
     // Set the PWM duty cycle to zero.
     OCR1A = 0;
@@ -237,83 +443,136 @@ void pwm_init(void)
              (0<<CS12) | (0<<CS11) | (1<<CS10);             // No prescaling.
 
     // Update the pwm values.
-    registers_write_byte(REG_PWM_DIRA, 0);
-    registers_write_byte(REG_PWM_DIRB, 0);
+    pwm_a = 0;
+    pwm_b = 0;
+    pwm_registers_update();
 }
 
 
 void pwm_update(uint16_t position, int16_t pwm)
 // Update the PWM signal being sent to the motor.  The PWM value should be
-// a signed integer in the range of -255 to -1 for clockwise movement,
-// 1 to 255 for counter-clockwise movement or zero to stop all movement.
+// a signed integer in the range of -MAX_PWM_OUTPUT to -1 for clockwise movement,
+// 1 to MAX_PWM_OUTPUT for counter-clockwise movement or zero to stop all movement.
 // This function provides a sanity check against the servo position and
 // will prevent the servo from being driven past a minimum and maximum
 // position.
 {
-    uint8_t pwm_width;
+    uint16_t pwm_width;
+#if PWM_BRAKE_ENABLED
+    uint16_t brake_width = 0;
+    int16_t velocity;
+#endif
     uint16_t min_position;
     uint16_t max_position;
 
-    // Quick check to see if the frequency divider changed.  If so we need to 
-    // configure a new top value for timer/counter1.  This value should only 
-    // change infrequently so we aren't too elegant in how we handle updating
-    // the value.  However, we need to be careful that we don't configure the
-    // top to a value lower than the counter and compare values.
-    if (registers_read_word(REG_PWM_FREQ_DIVIDER_HI, REG_PWM_FREQ_DIVIDER_LO) != pwm_div)
-    {
-        // Disable OC1A and OC1B outputs.
-        TCCR1A &= ~((1<<COM1A1) | (1<<COM1A0));
-        TCCR1A &= ~((1<<COM1B1) | (1<<COM1B0));
-
-        // Clear PB1 and PB2.
-        PORTB &= ~((1<<PB1) | (1<<PB2));
-
-        delay_loop(DELAYLOOP);
-
-        // Reset the A and B direction flags.
-        pwm_a = 0;
-        pwm_b = 0;
-
-        // Update the pwm frequency divider value.
-        pwm_div = registers_read_word(REG_PWM_FREQ_DIVIDER_HI, REG_PWM_FREQ_DIVIDER_LO);
-
-        // Update the timer top value.
-        ICR1 = PWM_TOP_VALUE(pwm_div);
-
-        // Reset the counter and compare values to prevent problems with the new top value.
-        TCNT1 = 0;
-        OCR1A = 0;
-        OCR1B = 0;
-    }
-
-    // Are we reversing the seek sense?
-    if (registers_read_byte(REG_REVERSE_SEEK) != 0)
+    // The frequency divider and position limits are only refreshed when the
+    // register write count shows the registers have changed so that the
+    // registers aren't read with interrupts disabled on every update.  This
+    // replaces three register word reads, about 84 cycles, with the 7 cycle
+    // write count check.
+    if (pwm_write_count != registers_get_write_count())
     {
-        // Yes. Swap the minimum and maximum position.
+        // Remember the count before reading so that a write during the
+        // refresh causes another refresh.
+        pwm_write_count = registers_get_write_count();
+
+        // Quick check to see if the frequency divider changed.  If so we need to 
+        // configure a new top value for timer/counter1.  This value should only 
+        // change infrequently so we aren't too elegant in how we handle updating
+        // the value.  However, we need to be careful that we don't configure the
+        // top to a value lower than the counter and compare values.
+        if (registers_read_word(REG_PWM_FREQ_DIVIDER_HI, REG_PWM_FREQ_DIVIDER_LO) != pwm_div)
+        {
+            // Disable OC1A and OC1B outputs.
+            TCCR1A &= ~((1<<COM1A1) | (1<<COM1A0));
+            TCCR1A &= ~((1<<COM1B1) | (1<<COM1B0));
+
+            // Clear PB1 and PB2.
+            PORTB &= ~((1<<PB1) | (1<<PB2));
+
+#if PWM_DEADTIME_ENABLED
+            // Cancel an output waiting for the dead time.
+            pwm_deadtime_count = 0;
+#else
+            delay_loop(DELAYLOOP);
+#endif
 
-        // Get the minimum and maximum seek position.
-        min_position = registers_read_word(REG_MAX_SEEK_HI, REG_MAX_SEEK_LO);
-        max_position = registers_read_word(REG_MIN_SEEK_HI, REG_MIN_SEEK_LO);
+            // Reset the A and B direction and brake flags.
+            pwm_a = 0;
+            pwm_b = 0;
+#if PWM_BRAKE_ENABLED
+            pwm_braking = 0;
+#endif
 
-        // Make sure these values are sane 10-bit values.
-        if (min_position > 0x3ff) min_position = 0x3ff;
-        if (max_position > 0x3ff) max_position = 0x3ff;
+            // Update the pwm frequency divider value.
+            pwm_div = registers_read_word(REG_PWM_FREQ_DIVIDER_HI, REG_PWM_FREQ_DIVIDER_LO);
+
+            // Update the timer top value.
+            pwm_top = PWM_TOP_VALUE(pwm_div);
+            ICR1 = pwm_top;
+
+            // Reset the counter and compare values to prevent problems with the new top value.
+            TCNT1 = 0;
+            OCR1A = 0;
+            OCR1B = 0;
+        }
+
+        // Are we reversing the seek sense?
+        pwm_reverse_seek = registers_read_byte(REG_REVERSE_SEEK);
+        if (pwm_reverse_seek != 0)
+        {
+            // Yes. Swap the minimum and maximum position.
+
+            // Get the minimum and maximum seek position.
+            min_position = registers_read_word(REG_MAX_SEEK_HI, REG_MAX_SEEK_LO);
+            max_position = registers_read_word(REG_MIN_SEEK_HI, REG_MIN_SEEK_LO);
+
+            // Make sure these values are sane 10-bit values.
+            if (min_position > 0x3ff) min_position = 0x3ff;
+            if (max_position > 0x3ff) max_position = 0x3ff;
+
+            // Adjust the values because of the reverse sense.
+            min_position = 0x3ff - min_position;
+            max_position = 0x3ff - max_position;
+        }
+        else
+        {
+            // No. Use the minimum and maximum position as is.
+
+            // Get the minimum and maximum seek position.
+            min_position = registers_read_word(REG_MIN_SEEK_HI, REG_MIN_SEEK_LO);
+            max_position = registers_read_word(REG_MAX_SEEK_HI, REG_MAX_SEEK_LO);
+
+            // Make sure these values are sane 10-bit values.
+            if (min_position > 0x3ff) min_position = 0x3ff;
+            if (max_position > 0x3ff) max_position = 0x3ff;
+        }
+
+        // Save the position limits.
+        pwm_min_position = min_position;
+        pwm_max_position = max_position;
+
+#if PWM_DEADTIME_ENABLED
+        // Save the direction change dead time.  At least one period is
+        // always used and the count must leave room for the partial periods
+        // added by pwm_deadtime_start().
+        pwm_deadtime = banks_read_byte(BANK_CONFIG, REG_PWM_DEADTIME);
+        if (pwm_deadtime < 1) pwm_deadtime = 1;
+        if (pwm_deadtime > PWM_DEADTIME_MAX) pwm_deadtime = PWM_DEADTIME_MAX;
+#endif
 
-        // Adjust the values because of the reverse sense.
-        min_position = 0x3ff - min_position;
-        max_position = 0x3ff - max_position;
+#if PWM_BRAKE_ENABLED
+        // Save the drive mode and braking duty.
+        pwm_drive_mode = banks_read_byte(BANK_CONFIG, REG_PWM_DRIVE_MODE);
+        pwm_brake_duty = (uint16_t) banks_read_byte(BANK_CONFIG, REG_PWM_BRAKE_DUTY) << PWM_OUTPUT_SHIFT;
+        pwm_brake_velocity = banks_read_byte(BANK_CONFIG, REG_PWM_BRAKE_VELOCITY);
+#endif
     }
     else
     {
-        // No. Use the minimum and maximum position as is.
-
-        // Get the minimum and maximum seek position.
-        min_position = registers_read_word(REG_MIN_SEEK_HI, REG_MIN_SEEK_LO);
-        max_position = registers_read_word(REG_MAX_SEEK_HI, REG_MAX_SEEK_LO);
-
-        // Make sure these values are sane 10-bit values.
-        if (min_position > 0x3ff) min_position = 0x3ff;
-        if (max_position > 0x3ff) max_position = 0x3ff;
+        // Use the saved position limits.
+        min_position = pwm_min_position;
+        max_position = pwm_max_position;
     }
 
     // Disable clockwise movements when position is below the minimum position.
@@ -323,7 +582,51 @@ void pwm_update(uint16_t position, int16_t pwm)
     if ((position > max_position) && (pwm > 0)) pwm = 0;
 
     // Determine if PWM is disabled in the registers.
-    if (!(registers_read_byte(REG_FLAGS_LO) & (1<<FLAGS_LO_PWM_ENABLED))) pwm = 0;
+    if (!(registers_read_byte(REG_FLAGS_LO) & (1<<FLAGS_LO_PWM_ENABLED)))
+    {
+        // Yes. A disabled PWM always lets the motor coast.
+        pwm = 0;
+#if PWM_BRAKE_ENABLED
+        pwm_decelerating = 0;
+#endif
+    }
+#if PWM_BRAKE_ENABLED
+    else if (pwm == 0)
+    {
+        // A zero output ends any deceleration.
+        pwm_decelerating = 0;
+
+        // Brake rather than coast if selected by the drive mode.
+        if ((pwm_drive_mode & PWM_DRIVE_MODE_MASK) == PWM_DRIVE_BRAKE) brake_width = MAX_PWM_OUTPUT;
+        if ((pwm_drive_mode & PWM_DRIVE_MODE_MASK) == PWM_DRIVE_BRAKE_DUTY) brake_width = pwm_brake_duty;
+    }
+    else if (pwm_drive_mode & PWM_DRIVE_DECEL)
+    {
+        // Get the velocity reported by the motion control algorithm with the
+        // seek sense removed so positive values move towards a higher position.
+        velocity = (int16_t) registers_read_word(REG_VELOCITY_HI, REG_VELOCITY_LO);
+        if (pwm_reverse_seek != 0) velocity = -velocity;
+
+        // Get the speed against the direction of the output.
+        if (pwm > 0) velocity = -velocity;
+
+        // Is the motion control algorithm decelerating the motor?  Braking
+        // starts above the brake velocity and continues down to half of it
+        // so that velocity noise doesn't chatter between braking and driving
+        // or keep the motor from starting from rest.
+        if (pwm_decelerating)
+            pwm_decelerating = (velocity > (pwm_brake_velocity >> 1));
+        else
+            pwm_decelerating = (velocity > pwm_brake_velocity);
+
+        if (pwm_decelerating)
+        {
+            // Yes. Brake with the PWM value rather than driving in reverse.
+            brake_width = (uint16_t) ((pwm < 0) ? -pwm : pwm);
+            pwm = 0;
+        }
+    }
+#endif
 
     // Determine direction of servo movement or stop.
     if (pwm < 0)
@@ -331,7 +634,7 @@ void pwm_update(uint16_t position, int16_t pwm)
         // Less than zero. Turn clockwise.
 
         // Get the PWM width from the PWM value.
-        pwm_width = (uint8_t) -pwm;
+        pwm_width = (uint16_t) -pwm;
 
         // Turn clockwise.
 #if SWAP_PWM_DIRECTION_ENABLED
@@ -345,7 +648,7 @@ void pwm_update(uint16_t position, int16_t pwm)
         // More than zero. Turn counter-clockwise.
 
         // Get the PWM width from the PWM value.
-        pwm_width = (uint8_t) pwm;
+        pwm_width = (uint16_t) pwm;
 
         // Turn counter-clockwise.
 #if SWAP_PWM_DIRECTION_ENABLED
@@ -355,6 +658,13 @@ void pwm_update(uint16_t position, int16_t pwm)
 #endif
 
     }
+#if PWM_BRAKE_ENABLED
+    else if (brake_width)
+    {
+        // Short the motor to brake.
+        pwm_brake(brake_width);
+    }
+#endif
     else
     {
         // Stop all PWM activity to the motor.
@@ -369,8 +679,12 @@ void pwm_stop(void)
     // Disable interrupts.
     cli();
 
-    // Are we moving in the A or B direction?
+    // Are we moving in the A or B direction or braking?
+#if PWM_BRAKE_ENABLED
+    if (pwm_a || pwm_b || pwm_braking)
+#else
     if (pwm_a || pwm_b)
+#endif
     {
         // Disable OC1A and OC1B outputs.
         TCCR1A &= ~((1<<COM1A1) | (1<<COM1A0));
@@ -379,11 +693,20 @@ void pwm_stop(void)
         // Clear PB1 and PB2.
         PORTB &= ~((1<<PB1) | (1<<PB2));
 
+#if PWM_DEADTIME_ENABLED
+        // Cancel an output waiting for the dead time.  The next direction
+        // change starts a new dead time.
+        pwm_deadtime_count = 0;
+#else
         delay_loop(DELAYLOOP);
+#endif
 
-        // Reset the A and B direction flags.
+        // Reset the A and B direction and brake flags.
         pwm_a = 0;
         pwm_b = 0;
+#if PWM_BRAKE_ENABLED
+        pwm_braking = 0;
+#endif
     }
 
     // Set the PWM duty cycle to zero.
@@ -394,7 +717,81 @@ void pwm_stop(void)
     sei();
 
     // Save the pwm A and B duty values.
-    registers_write_byte(REG_PWM_DIRA, pwm_a);
-    registers_write_byte(REG_PWM_DIRB, pwm_b);
+    pwm_registers_update();
+}
+
+
+#if BEMF_ENABLED
+
+void pwm_float(void)
+// Float the H-bridge by disconnecting the PWM outputs so the motor back-EMF
+// can be sampled.  The direction flags are kept so pwm_drive() can restore
+// the output.  This function is meant to be called only from interrupts.
+{
+    // Disable OC1A and OC1B outputs.
+    TCCR1A &= ~((1<<COM1A1) | (1<<COM1A0) | (1<<COM1B1) | (1<<COM1B0));
+
+    // Clear PB1 and PB2.
+    PORTB &= ~((1<<PB1) | (1<<PB2));
+
+    // Keep a direction change from enabling the output while floating.
+    pwm_floating = 1;
+}
+
+
+void pwm_drive(void)
+// Reconnect the PWM output for the current direction after pwm_float().
+// This function is meant to be called only from interrupts.
+{
+    pwm_floating = 0;
+
+#if PWM_DEADTIME_ENABLED
+    // The output is enabled by the overflow interrupt after the dead time.
+    if (pwm_deadtime_count) return;
+
+#endif
+    // Enable the output of the direction being driven, if any.
+    if (pwm_a)
+        TCCR1A |= (1<<COM1A1);
+    else if (pwm_b)
+        TCCR1A |= (1<<COM1B1);
+#if PWM_BRAKE_ENABLED
+    else if (pwm_braking)
+        TCCR1A |= (1<<COM1A1) | (1<<COM1B1);
+#endif
+}
+
+#endif // BEMF_ENABLED
+
+#if PWM_DEADTIME_ENABLED
+
+ISR(TIMER1_OVF_vect)
+// Handles timer/counter1 overflow at BOTTOM, the middle of the PWM on time.
+// Counts down the dead time after a direction change and then enables the
+// pending output.  The overflow also starts a power conversion synchronized
+// with the PWM when the ADC module is waiting for one.
+{
+#if ADC_POWER_SYNC_ENABLED && defined(__AVR_ATmega8__)
+    adc_power_sync_overflow();
+#endif
+
+    // Has the dead time passed?
+    if (pwm_deadtime_count && !--pwm_deadtime_count)
+    {
+#if BEMF_ENABLED
+        // A floated H-bridge is enabled by pwm_drive().
+        if (!pwm_floating)
+#endif
+        // Enable the pending output.
+        TCCR1A |= pwm_deadtime_output;
+    }
+
+    // Disable the interrupt when nothing is waiting for the overflow.
+#if ADC_POWER_SYNC_ENABLED && defined(__AVR_ATmega8__)
+    if (!pwm_deadtime_count && !adc_power_sync_pending) TIMSK &= ~(1<<TOIE1);
+#else
+    if (!pwm_deadtime_count) TIMSK &= ~(1<<TOIE1);
+#endif
 }
 
+#endif // PWM_DEADTIME_ENABLED
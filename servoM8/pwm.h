@@ -29,10 +29,38 @@
 
 #include "registers.h"
 
+// The signed PWM output of the motion control algorithms is in the range
+// -MAX_PWM_OUTPUT to MAX_PWM_OUTPUT and carries PWM_OUTPUT_SHIFT more bits
+// of resolution than the original 8-bit output.
+#if PWM_WIDE_ENABLED
+#define PWM_OUTPUT_SHIFT        2
+#else
+#define PWM_OUTPUT_SHIFT        0
+#endif
+#define MAX_PWM_OUTPUT          ((256 << PWM_OUTPUT_SHIFT) - 1)
+
+#if PWM_BRAKE_ENABLED
+// Drive modes selected by REG_PWM_DRIVE_MODE.  The low bits select what a zero
+// output does and PWM_DRIVE_DECEL brakes rather than drives in reverse while the
+// motion control algorithm decelerates the motor.
+#define PWM_DRIVE_COAST         0x00
+#define PWM_DRIVE_BRAKE         0x01
+#define PWM_DRIVE_BRAKE_DUTY    0x02
+#define PWM_DRIVE_MODE_MASK     0x03
+#define PWM_DRIVE_DECEL         0x80
+#endif
+
+// Exported variables.
+extern uint8_t pwm_reverse_seek;
+
 void pwm_registers_defaults(void);
 void pwm_init(void);
 void pwm_update(uint16_t position, int16_t pwm);
 void pwm_stop(void);
+#if BEMF_ENABLED
+void pwm_float(void);
+void pwm_drive(void);
+#endif
 
 inline static void pwm_enable(void)
 {
@@ -55,4 +83,11 @@ inline static void pwm_disable(void)
 }
 
 
+inline static uint8_t pwm_is_reverse_seek(void)
+// Return the REG_REVERSE_SEEK seek sense as of the last pwm_update().
+{
+    return pwm_reverse_seek;
+}
+
+
 #endif // _OS_PWM_H_
@@ -29,9 +29,18 @@
 
 #include "openservo.h"
 #include "config.h"
+#include "adc.h"
+#include "autotune.h"
+#include "cascade.h"
+#include "controller.h"
 #include "eeprom.h"
 #include "estimator.h"
+#include "friction.h"
+#include "voltage.h"
+#include "bemf.h"
+#include "slew.h"
 #include "ipd.h"
+#include "linear.h"
 #include "pid.h"
 #include "pwm.h"
 #include "regulator.h"
@@ -40,6 +49,9 @@
 // Register values.
 uint8_t registers[REGISTER_COUNT];
 
+// Count of writes to the upper registers.
+volatile uint8_t registers_write_count;
+
 void registers_init(void)
 // Function to initialize all registers.
 {
@@ -57,8 +69,8 @@ void registers_init(void)
     // read/write protected registers should be initialized to defaults.
     if (!eeprom_restore_registers())
     {
-        // Reset read/write protected registers to zero.
-        memset(&registers[MIN_WRITE_PROTECT_REGISTER], WRITE_PROTECT_REGISTER_COUNT + REDIRECT_REGISTER_COUNT, REGISTER_COUNT);
+        // Reset read/write protected, redirect and bank registers to zero.
+        memset(&registers[MIN_WRITE_PROTECT_REGISTER], 0, REGISTER_COUNT - MIN_WRITE_PROTECT_REGISTER);
 
         // Initialize read/write protected registers to defaults.
         registers_defaults();
@@ -77,6 +89,11 @@ void registers_defaults(void)
     // Call the PWM module to initialize the PWM related default values.
     pwm_registers_defaults();
 
+#if ADC_SAMPLE_PERIOD_ENABLED
+    // Call the ADC module to initialize the ADC related default values.
+    adc_registers_defaults();
+#endif
+
 #if ESTIMATOR_ENABLED
     // Call the motion module to initialize the velocity estimator related 
     // default values. This is done so the estimator related parameters can
@@ -84,19 +101,38 @@ void registers_defaults(void)
     estimator_registers_defaults();
 #endif
 
-#if REGULATOR_MOTION_ENABLED
-    // Call the regulator module to initialize the regulator related default values.
-    regulator_registers_defaults();
+    // Call the controller module to initialize the default values of
+    // the included motion control algorithms.
+    controller_registers_defaults();
+
+#if LINEAR_ENABLED
+    // Call the linearization module to initialize the linearization table.
+    linear_registers_defaults();
+#endif
+
+#if FRICTION_ENABLED
+    // Call the friction module to initialize the friction compensation default values.
+    friction_registers_defaults();
+#endif
+
+#if VOLTAGE_COMP_ENABLED
+    // Call the voltage module to initialize the supply voltage compensation default values.
+    voltage_registers_defaults();
+#endif
+
+#if BEMF_ENABLED
+    // Call the back-EMF module to initialize the back-EMF velocity default values.
+    bemf_registers_defaults();
 #endif
 
-#if PID_MOTION_ENABLED
-    // Call the PID module to initialize the PID related default values.
-    pid_registers_defaults();
+#if SLEW_ENABLED
+    // Call the slew module to initialize the output slew rate limiter default values.
+    slew_registers_defaults();
 #endif
 
-#if IPD_MOTION_ENABLED
-    // Call the IPD module to initialize the IPD related default values.
-    ipd_registers_defaults();
+#if AUTOTUNE_ENABLED
+    // Call the autotune module to initialize the autotune related default values.
+    autotune_registers_defaults();
 #endif
 }
 
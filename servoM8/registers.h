@@ -117,17 +117,14 @@
 #define MIN_WRITE_PROTECT_REGISTER  0x20
 #define MAX_WRITE_PROTECT_REGISTER  0x37
 #define MIN_UNUSED_REGISTER         0x38
-#define MAX_UNUSED_REGISTER         0x5F
+#define MAX_UNUSED_REGISTER         0x3E
+#define MIN_BANK_REGISTER           0x40
+#define MAX_BANK_REGISTER           0x5F
 #define MIN_REDIRECT_REGISTER       0x60
 #define MAX_REDIRECT_REGISTER       0x6F
 #define MIN_REDIRECTED_REGISTER     0x70
 #define MAX_REDIRECTED_REGISTER     0x7F
 
-
-// Define the total number of registers define.  This includes 
-// all registers except unused and redirected registers.
-#define REGISTER_COUNT              (MIN_UNUSED_REGISTER + 16)
-
 #else // ESTIMATOR_ENABLED
 
 //
@@ -140,24 +137,214 @@
 #define MIN_WRITE_PROTECT_REGISTER  0x20
 #define MAX_WRITE_PROTECT_REGISTER  0x2F
 #define MIN_UNUSED_REGISTER         0x30
-#define MAX_UNUSED_REGISTER         0x5F
+#define MAX_UNUSED_REGISTER         0x3E
+#define MIN_BANK_REGISTER           0x40
+#define MAX_BANK_REGISTER           0x5F
 #define MIN_REDIRECT_REGISTER       0x60
 #define MAX_REDIRECT_REGISTER       0x6F
 #define MIN_REDIRECTED_REGISTER     0x70
 #define MAX_REDIRECTED_REGISTER     0x7F
 
-// Define the total number of registers define.  This includes 
-// all registers except unused and redirected registers.
-#define REGISTER_COUNT              (MIN_UNUSED_REGISTER + 16)
-
 #endif // ESTIMATOR_ENABLED
 
+// TWI bank select register.  This register is always writable and
+// selects which bank of registers appears in the bank register window.
+#define REG_BANK_SELECT             0x3F
+
+// TWI sample FIFO registers.  These read only registers sit at the top of
+// the unused register range and are only present when FIFO_ENABLED.
+#define REG_FIFO_STATUS             0x3D
+#define REG_FIFO_DATA               0x3E
+
+//
+// Define the register banks.  Bank 0 holds read only status registers
+// and the remaining banks hold write protected registers which are
+// saved to EEPROM along with the other write protected registers.
+//
+
+#define BANK_STATUS                 0x00
+#define BANK_CONFIG                 0x01
+#define BANK_GAINS                  0x02
+#define BANK_CASCADE                0x03
+#define BANK_CONTROLLER             0x04
+#define BANK_LINEAR                 0x05
+#define BANK_COUNT                  6
+
+// Only the banks of the features included in the build are stored in the
+// registers array and saved to EEPROM.  The controller slots are only
+// needed when more than one motion control algorithm is included.
+#define BANK_GAINS_PRESENT          (PID_GAIN_SCHEDULE_ENABLED)
+#define BANK_CASCADE_PRESENT        (CASCADE_MOTION_ENABLED)
+#define BANK_CONTROLLER_PRESENT     ((PID_MOTION_ENABLED + IPD_MOTION_ENABLED + REGULATOR_MOTION_ENABLED + CASCADE_MOTION_ENABLED) > 1)
+#define BANK_LINEAR_PRESENT         (LINEAR_ENABLED)
+
+// Storage slot of each bank in the registers array.  The banks that are
+// present are stored in order and missing banks have no slot.
+#define BANK_SLOT_NONE              0xFF
+#define BANK_SLOT_GAINS_NEXT        (2 + BANK_GAINS_PRESENT)
+#define BANK_SLOT_CASCADE_NEXT      (BANK_SLOT_GAINS_NEXT + BANK_CASCADE_PRESENT)
+#define BANK_SLOT_CONTROLLER_NEXT   (BANK_SLOT_CASCADE_NEXT + BANK_CONTROLLER_PRESENT)
+#define BANK_SLOT_COUNT             (BANK_SLOT_CONTROLLER_NEXT + BANK_LINEAR_PRESENT)
+
+#define BANK_SLOT(bank)     ((bank) == BANK_STATUS ? 0 : \
+                             (bank) == BANK_CONFIG ? 1 : \
+                             (bank) == BANK_GAINS ? (BANK_GAINS_PRESENT ? 2 : BANK_SLOT_NONE) : \
+                             (bank) == BANK_CASCADE ? (BANK_CASCADE_PRESENT ? BANK_SLOT_GAINS_NEXT : BANK_SLOT_NONE) : \
+                             (bank) == BANK_CONTROLLER ? (BANK_CONTROLLER_PRESENT ? BANK_SLOT_CASCADE_NEXT : BANK_SLOT_NONE) : \
+                             (bank) == BANK_LINEAR ? (BANK_LINEAR_PRESENT ? BANK_SLOT_CONTROLLER_NEXT : BANK_SLOT_NONE) : \
+                             BANK_SLOT_NONE)
+
+// Mask of the banks present used to tell EEPROM images of different builds apart.
+#define BANK_PRESENT_MASK   ((BANK_GAINS_PRESENT << BANK_GAINS) | (BANK_CASCADE_PRESENT << BANK_CASCADE) | \
+                             (BANK_CONTROLLER_PRESENT << BANK_CONTROLLER) | (BANK_LINEAR_PRESENT << BANK_LINEAR))
+
+// Bank 0: read only status registers.
+
+#define REG_SEEK_ACCELERATION_HI    0x40
+#define REG_SEEK_ACCELERATION_LO    0x41
+#define REG_AUTOTUNE_STATUS         0x42
+#define REG_AUTOTUNE_KU_HI          0x43
+#define REG_AUTOTUNE_KU_LO          0x44
+#define REG_AUTOTUNE_TU_HI          0x45
+#define REG_AUTOTUNE_TU_LO          0x46
+#define REG_POSITION_HIRES_HI       0x47
+#define REG_POSITION_HIRES_LO       0x48
+#define REG_LINEAR_STATUS           0x49
+#define REG_POSITION_OUTLIERS_HI    0x4A
+#define REG_POSITION_OUTLIERS_LO    0x4B
+#define REG_BEMF_VELOCITY_HI        0x4C
+#define REG_BEMF_VELOCITY_LO        0x4D
+#define REG_POSITION_SEQUENCE       0x4E
+#define REG_POWER_SEQUENCE          0x4F
+#define REG_POSITION_OVERRUNS_HI    0x50
+#define REG_POSITION_OVERRUNS_LO    0x51
+#define REG_POWER_OVERRUNS_HI       0x52
+#define REG_POWER_OVERRUNS_LO       0x53
+#define REG_WORST_GAP               0x54
+#define REG_SAMPLE_JITTER           0x55
+#define REG_SAMPLE_LATENCY          0x56
+#define REG_PWM_WIDE_DIRA_HI        0x57
+#define REG_PWM_WIDE_DIRA_LO        0x58
+#define REG_PWM_WIDE_DIRB_HI        0x59
+#define REG_PWM_WIDE_DIRB_LO        0x5A
+#define REG_SLEW_SATURATION_HI      0x5B
+#define REG_SLEW_SATURATION_LO      0x5C
+
+// Bank 1: write protected configuration registers.
+
+#define REG_PID_VFF_GAIN_HI         0x40
+#define REG_PID_VFF_GAIN_LO         0x41
+#define REG_PID_AFF_GAIN_HI         0x42
+#define REG_PID_AFF_GAIN_LO         0x43
+#define REG_AUTOTUNE_RELAY          0x44
+#define REG_AUTOTUNE_HYSTERESIS     0x45
+#define REG_FILTER_POSITION_TYPE    0x46
+#define REG_FILTER_POSITION_COEFF   0x47
+#define REG_FILTER_VELOCITY_TYPE    0x48
+#define REG_FILTER_VELOCITY_COEFF   0x49
+#define REG_SAMPLE_PERIOD           0x4A
+#define REG_CONTROLLER_SELECT       0x4B
+#define REG_FRICTION_COULOMB        0x4C
+#define REG_FRICTION_BREAKAWAY      0x4D
+#define REG_FRICTION_VELOCITY       0x4E
+#define REG_FRICTION_DITHER         0x4F
+#define REG_VOLTAGE_NOMINAL_HI      0x50
+#define REG_VOLTAGE_NOMINAL_LO      0x51
+#define REG_BEMF_ENABLE             0x52
+#define REG_BEMF_BLANKING           0x53
+#define REG_BEMF_SCALE              0x54
+#define REG_BEMF_OFFSET_HI          0x55
+#define REG_BEMF_OFFSET_LO          0x56
+#define REG_PWM_DEADTIME            0x57
+#define REG_PWM_DRIVE_MODE          0x58
+#define REG_PWM_BRAKE_DUTY          0x59
+#define REG_SLEW_RISE               0x5A
+#define REG_SLEW_FALL               0x5B
+#define REG_SLEW_JERK               0x5C
+#define REG_PWM_BRAKE_VELOCITY      0x5D
+
+// Bank 2: write protected gain registers.
+
+#define REG_GAIN_SCHEDULE_FLAGS     0x40
+#define REG_GAIN_SCHEDULE_SHIFT     0x41
+#define REG_GAIN_SCHEDULE_P0        0x42
+#define REG_GAIN_SCHEDULE_P1        0x43
+#define REG_GAIN_SCHEDULE_P2        0x44
+#define REG_GAIN_SCHEDULE_P3        0x45
+#define REG_GAIN_SCHEDULE_P4        0x46
+#define REG_GAIN_SCHEDULE_D0        0x47
+#define REG_GAIN_SCHEDULE_D1        0x48
+#define REG_GAIN_SCHEDULE_D2        0x49
+#define REG_GAIN_SCHEDULE_D3        0x4A
+#define REG_GAIN_SCHEDULE_D4        0x4B
+#define REG_GAIN_ZONE_0             0x4C
+#define REG_GAIN_ZONE_1             0x4D
+#define REG_GAIN_ZONE_2             0x4E
+#define REG_GAIN_ZONE_3             0x4F
+#define REG_GAIN_ZONE_4             0x50
+
+// Bank 3: write protected cascade algorithm gain and limit registers.
+
+#define REG_CASCADE_POSITION_GAIN_HI    0x40
+#define REG_CASCADE_POSITION_GAIN_LO    0x41
+#define REG_CASCADE_VELOCITY_LIMIT_HI   0x42
+#define REG_CASCADE_VELOCITY_LIMIT_LO   0x43
+#define REG_CASCADE_VELOCITY_PGAIN_HI   0x44
+#define REG_CASCADE_VELOCITY_PGAIN_LO   0x45
+#define REG_CASCADE_VELOCITY_IGAIN_HI   0x46
+#define REG_CASCADE_VELOCITY_IGAIN_LO   0x47
+#define REG_CASCADE_CURRENT_LIMIT_HI    0x48
+#define REG_CASCADE_CURRENT_LIMIT_LO    0x49
+#define REG_CASCADE_CURRENT_PGAIN_HI    0x4A
+#define REG_CASCADE_CURRENT_PGAIN_LO    0x4B
+#define REG_CASCADE_CURRENT_IGAIN_HI    0x4C
+#define REG_CASCADE_CURRENT_IGAIN_LO    0x4D
+
+// Bank 4: write protected controller gain slots.  Each slot holds a copy
+// of REG_PID_DEADBAND thru REG_PID_IGAIN_LO for one controller.  The bank
+// is only present when more than one controller is included.
+
+#define REG_CONTROLLER_GAINS        0x40
+#define CONTROLLER_GAINS_SIZE       (REG_PID_IGAIN_LO - REG_PID_DEADBAND + 1)
+
+// Bank 5: write protected position linearization table.  The signed
+// corrections for the 17 table points are followed by the enable flag
+// and the calibration reference position.
+
+#define REG_LINEAR_POINT_0          0x40
+#define REG_LINEAR_ENABLE           0x51
+#define REG_LINEAR_REFERENCE_HI     0x52
+#define REG_LINEAR_REFERENCE_LO     0x53
+
 // Define the number of write protect registers.
 #define WRITE_PROTECT_REGISTER_COUNT    (MAX_WRITE_PROTECT_REGISTER - MIN_WRITE_PROTECT_REGISTER + 1)
 
 // Define the number of redirect registers.
 #define REDIRECT_REGISTER_COUNT         (MAX_REDIRECT_REGISTER - MIN_REDIRECT_REGISTER + 1)
 
+// Define the number of registers in each bank.
+#define BANK_REGISTER_COUNT             (MAX_BANK_REGISTER - MIN_BANK_REGISTER + 1)
+
+// Define the number of write protect bank registers.  These are all banks
+// present except the read only status bank.
+#define WRITE_PROTECT_BANK_REGISTER_COUNT   ((BANK_SLOT_COUNT - 1) * BANK_REGISTER_COUNT)
+
+// Determine the index of a bank register within the register array.  The
+// banks present are stored in slot order following the redirect registers.
+#define BANK_REGISTER_INDEX(bank, address)  (MIN_UNUSED_REGISTER + REDIRECT_REGISTER_COUNT + \
+                                             (BANK_SLOT(bank) * BANK_REGISTER_COUNT) + ((address) - MIN_BANK_REGISTER))
+
+// Define the total number of registers define.  This includes all
+// registers except unused, bank select and redirected registers.
+#define REGISTER_COUNT              (MIN_UNUSED_REGISTER + REDIRECT_REGISTER_COUNT + (BANK_SLOT_COUNT * BANK_REGISTER_COUNT))
+
+//
+// Define the gain schedule register REG_GAIN_SCHEDULE_FLAGS bits.
+//
+
+#define GAIN_SCHEDULE_ERROR_ENABLED     0x00
+#define GAIN_SCHEDULE_ZONE_ENABLED      0x01
+
 //
 // Define the flag register REG_FLAGS_HI and REG_FLAGS_LO bits.
 //
@@ -182,10 +369,15 @@
 
 // Global register array.  Note: to minimize memory the register count doesn't
 // include the unused and redirected registers.  For this reason care must be
-// taken when referencing the redirect registers which come after the unused
-// registers in this array.
+// taken when referencing the redirect and bank registers which come after the
+// unused registers in this array.
 extern uint8_t registers[REGISTER_COUNT];
 
+// Count of writes to the write protected, bank and redirect registers.
+// Modules keep a decoded copy of their parameters from these registers
+// and only refresh it when this count changes.
+extern volatile uint8_t registers_write_count;
+
 // Register functions.
 
 void registers_init(void);
@@ -209,6 +401,55 @@ inline static void registers_write_byte(uint8_t address, uint8_t value)
 }
 
 
+// Flag the upper registers as changed.
+inline static void registers_changed(void)
+{
+    ++registers_write_count;
+}
+
+
+// Get the count of writes to the upper registers.
+inline static uint8_t registers_get_write_count(void)
+{
+    return registers_write_count;
+}
+
+
+// Check whether a register bank is present in the build.
+inline static uint8_t banks_is_present(uint8_t bank)
+{
+    return BANK_SLOT(bank) != BANK_SLOT_NONE;
+}
+
+
+// Read a single byte from a register bank.
+inline static uint8_t banks_read_byte(uint8_t bank, uint8_t address)
+{
+    return registers[BANK_REGISTER_INDEX(bank, address)];
+}
+
+
+// Write a single byte to a register bank.
+inline static void banks_write_byte(uint8_t bank, uint8_t address, uint8_t value)
+{
+    registers[BANK_REGISTER_INDEX(bank, address)] = value;
+}
+
+
+// Read a 16-bit word from a register bank.
+inline static uint16_t banks_read_word(uint8_t bank, uint8_t address_hi, uint8_t address_lo)
+{
+    return registers_read_word(BANK_REGISTER_INDEX(bank, address_hi), BANK_REGISTER_INDEX(bank, address_lo));
+}
+
+
+// Write a 16-bit word to a register bank.
+inline static void banks_write_word(uint8_t bank, uint8_t address_hi, uint8_t address_lo, uint16_t value)
+{
+    registers_write_word(BANK_REGISTER_INDEX(bank, address_hi), BANK_REGISTER_INDEX(bank, address_lo), value);
+}
+
+
 inline static void registers_write_enable(void)
 {
     uint8_t flags_lo = registers_read_byte(REG_FLAGS_LO);
@@ -28,7 +28,10 @@
 
 #include "openservo.h"
 #include "config.h"
+#include "adc.h"
+#include "controller.h"
 #include "math.h"
+#include "pwm.h"
 #include "regulator.h"
 #include "registers.h"
 
@@ -40,7 +43,7 @@
 #define MAX_POSITION            (1023)
 
 // The minimum and maximum output.
-#define MAX_OUTPUT              (255)
+#define MAX_OUTPUT              (MAX_PWM_OUTPUT)
 #define MIN_OUTPUT              (-MAX_OUTPUT)
 
 
@@ -71,7 +74,7 @@ void regulator_registers_defaults(void)
 int16_t regulator_position_to_pwm(int16_t current_position)
 // This function takes the current servo position as input and outputs a pwm
 // value for the servo motors.  The current position value must be within the
-// range 0 and 1023. The output will be within the range of -255 and 255 with
+// range 0 and 1023. The output will be within the range of -MAX_PWM_OUTPUT and MAX_PWM_OUTPUT with
 // values less than zero indicating clockwise rotation and values more than
 // zero indicating counter-clockwise rotation.
 {
@@ -114,6 +117,12 @@ int16_t regulator_position_to_pwm(int16_t current_position)
     // Determine the current error.
     current_error = command_position - current_position;
 
+#if FRICTION_ENABLED
+    // Report the error and the estimated velocity to the friction
+    // compensation.  The estimate is per sample with 11 fractional bits.
+    controller_set_motion(current_error, (int16_t) (((int32_t) current_velocity * adc_get_sample_ticks()) >> 11));
+#endif
+
 	// The following operations are fixed point operations. To add/substract
 	// two fixed point values they must have the same fractional precision
     // (the same number of bits behind the decimal).  When two fixed point
@@ -131,11 +140,11 @@ int16_t regulator_position_to_pwm(int16_t current_position)
     // Position state z1:  fp_z1     =  5 
     // Velocity state z2:  fp_z2     = 11
 	// Real Position  x1:  fp_x1     =  0
-	// PWM output:         fp_output =  0
+	// PWM output:         fp_output =  PWM_OUTPUT_SHIFT
 
 	// output = k1 * x1 + k2 * x2
-    output  = fixed_multiply(k1, current_error, 5);         // fp: 5 + 0  -> 0 : rshift = 5
-    output += fixed_multiply(k2, -current_velocity, 16);    // fp: 5 + 11 -> 0 : rshift = 16
+    output  = fixed_multiply(k1, current_error, 5 - PWM_OUTPUT_SHIFT);         // fp: 5 + 0  -> S : rshift = 5 - S
+    output += fixed_multiply(k2, -current_velocity, 16 - PWM_OUTPUT_SHIFT);    // fp: 5 + 11 -> S : rshift = 16 - S
 
     // Check for output saturation.
     if (output > MAX_OUTPUT) output = MAX_OUTPUT;
@@ -0,0 +1,155 @@
+/*
+    Copyright (c) 2006 Michael P. Thompson <mpthompson@gmail.com>
+
+    Permission is hereby granted, free of charge, to any person 
+    obtaining a copy of this software and associated documentation 
+    files (the "Software"), to deal in the Software without 
+    restriction, including without limitation the rights to use, copy, 
+    modify, merge, publish, distribute, sublicense, and/or sell copies 
+    of the Software, and to permit persons to whom the Software is 
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be 
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+
+    $Id$
+*/
+
+#include <inttypes.h>
+
+#include "openservo.h"
+#include "config.h"
+#include "pwm.h"
+#include "slew.h"
+#include "registers.h"
+
+// Compile following for the output slew rate limiter.
+#if SLEW_ENABLED
+
+//
+// Output Slew Rate Limiter
+//
+// A motion control algorithm can swing its output from full reverse to
+// full forward in a single sample which draws a current spike from the
+// supply and shocks the gear train.  This stage sits between the motion
+// control output and pwm_update and limits how far the PWM moves each
+// sample period.
+//
+// REG_SLEW_RISE limits the step when the PWM magnitude grows and
+// REG_SLEW_FALL when it shrinks.  A PWM reversing through zero is first
+// brought to zero at the fall rate and then grows at the rise rate.
+// REG_SLEW_JERK optionally limits how much the step may grow from one
+// sample to the next so the PWM follows an S-curve.  Shrinking the step
+// is never limited so the output doesn't overshoot the motion control
+// output.  The limits are in PWM units per sample period and a limit of
+// zero disables it.  Each sample period the output is limited counts in
+// REG_SLEW_SATURATION.
+//
+
+// Values preserved across multiple iterations.
+static int16_t slew_output;
+static int16_t slew_step;
+static uint16_t slew_saturation;
+
+
+void slew_init(void)
+// Initialize the output slew rate limiter module.
+{
+    slew_output = 0;
+    slew_step = 0;
+    slew_saturation = 0;
+
+    // Report the saturation count.
+    banks_write_word(BANK_STATUS, REG_SLEW_SATURATION_HI, REG_SLEW_SATURATION_LO, slew_saturation);
+}
+
+
+void slew_registers_defaults(void)
+// Initialize the output slew rate limiter related register values.
+{
+    banks_write_byte(BANK_CONFIG, REG_SLEW_RISE, DEFAULT_SLEW_RISE);
+    banks_write_byte(BANK_CONFIG, REG_SLEW_FALL, DEFAULT_SLEW_FALL);
+    banks_write_byte(BANK_CONFIG, REG_SLEW_JERK, DEFAULT_SLEW_JERK);
+}
+
+
+int16_t slew_limit(int16_t pwm)
+// Take the signed PWM output as input and output the PWM moved towards
+// it no faster than the rise, fall and jerk limits allow.
+{
+    int16_t output;
+    int16_t target;
+    int16_t step;
+    int16_t limit;
+    int16_t jerk;
+
+    output = slew_output;
+
+    // Shrink the output towards the requested PWM, or towards zero if reversing.
+    target = (((output > 0) && (pwm < 0)) || ((output < 0) && (pwm > 0))) ? 0 : pwm;
+    if (((output > 0) && (target < output)) || ((output < 0) && (target > output)))
+    {
+        step = target - output;
+
+        // Apply the fall limit.
+        limit = (int16_t) banks_read_byte(BANK_CONFIG, REG_SLEW_FALL) << PWM_OUTPUT_SHIFT;
+        if (limit)
+        {
+            if (step > limit) step = limit;
+            if (step < -limit) step = -limit;
+        }
+
+        output += step;
+    }
+
+    // Grow the output towards the requested PWM.
+    if (((output >= 0) && (pwm > output)) || ((output <= 0) && (pwm < output)))
+    {
+        step = pwm - output;
+
+        // Apply the rise limit.
+        limit = (int16_t) banks_read_byte(BANK_CONFIG, REG_SLEW_RISE) << PWM_OUTPUT_SHIFT;
+
+        // Apply the jerk limit which allows the step to grow from the
+        // previous step in the same direction.
+        jerk = (int16_t) banks_read_byte(BANK_CONFIG, REG_SLEW_JERK) << PWM_OUTPUT_SHIFT;
+        if (jerk)
+        {
+            if ((step > 0) && (slew_step > 0)) jerk += slew_step;
+            if ((step < 0) && (slew_step < 0)) jerk -= slew_step;
+            if (!limit || (jerk < limit)) limit = jerk;
+        }
+
+        if (limit)
+        {
+            if (step > limit) step = limit;
+            if (step < -limit) step = -limit;
+        }
+
+        output += step;
+    }
+
+    // Count the sample periods the output was limited.
+    if (output != pwm)
+    {
+        if (slew_saturation < 0xFFFF) ++slew_saturation;
+        banks_write_word(BANK_STATUS, REG_SLEW_SATURATION_HI, REG_SLEW_SATURATION_LO, slew_saturation);
+    }
+
+    // Remember the output and how far it moved.
+    slew_step = output - slew_output;
+    slew_output = output;
+
+    return output;
+}
+
+#endif // SLEW_ENABLED
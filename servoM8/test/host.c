@@ -0,0 +1,73 @@
+/*
+    Host support for running the OpenServo modules in the host tests.
+
+    Replaces registers.c whose interrupt handling is AVR assembly.
+*/
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "openservo.h"
+#include "config.h"
+#include "registers.h"
+#include "host.h"
+
+// The register array and write count normally in registers.c.
+uint8_t registers[REGISTER_COUNT];
+volatile uint8_t registers_write_count;
+
+// Count of failed checks.
+int host_failures;
+
+
+uint16_t registers_read_word(uint8_t address_hi, uint8_t address_lo)
+// Read a 16-bit word from the registers.
+{
+    return (registers[address_hi] << 8) | registers[address_lo];
+}
+
+
+void registers_write_word(uint8_t address_hi, uint8_t address_lo, uint16_t value)
+// Write a 16-bit word to the registers.
+{
+    registers[address_hi] = value >> 8;
+    registers[address_lo] = value;
+}
+
+
+void host_check(int cond, const char *text, const char *file, int line)
+// Report a failed check.
+{
+    if (cond) return;
+
+    printf("%s:%d: check failed: %s\n", file, line, text);
+    ++host_failures;
+}
+
+
+int host_result(void)
+// Return the exit status of a test from the failed checks.
+{
+    printf("%s\n", host_failures ? "FAILED" : "passed");
+
+    return host_failures ? 1 : 0;
+}
+
+
+void host_registers_reset(void)
+// Reset the registers to zero with PWM enabled and the position limits open.
+{
+    memset(registers, 0, sizeof(registers));
+
+    registers_write_byte(REG_FLAGS_LO, (1<<FLAGS_LO_PWM_ENABLED));
+    registers_write_word(REG_MIN_SEEK_HI, REG_MIN_SEEK_LO, 0);
+    registers_write_word(REG_MAX_SEEK_HI, REG_MAX_SEEK_LO, 1023);
+}
+
+
+void host_write_word(uint8_t address_hi, uint8_t address_lo, uint16_t value)
+// Write a register word and flag the registers as changed.
+{
+    registers_write_word(address_hi, address_lo, value);
+    registers_changed();
+}
@@ -0,0 +1,31 @@
+/*
+    Host support for running the OpenServo modules in the host tests.
+*/
+
+#ifndef _OS_TEST_HOST_H_
+#define _OS_TEST_HOST_H_ 1
+
+#include <stdio.h>
+#include <inttypes.h>
+
+// Count of failed checks.
+extern int host_failures;
+
+// Check a condition and report it if it fails.
+#define CHECK(cond) host_check((cond), #cond, __FILE__, __LINE__)
+
+// Report a failed check.
+void host_check(int cond, const char *text, const char *file, int line);
+
+// Return the exit status of a test from the failed checks.
+int host_result(void);
+
+// Reset the registers to zero with PWM enabled, the position limits open
+// and an unchanged write count.
+void host_registers_reset(void);
+
+// Write a register word and flag the registers as changed as the TWI
+// write path does.
+void host_write_word(uint8_t address_hi, uint8_t address_lo, uint16_t value);
+
+#endif // _OS_TEST_HOST_H_
@@ -0,0 +1,64 @@
+/*
+    Simulated servo plant for the host tests.
+*/
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "openservo.h"
+#include "config.h"
+#include "pwm.h"
+#include "plant.h"
+
+// Sample period and the integration steps in each.
+#define PLANT_PERIOD        0.010
+#define PLANT_STEPS         20
+
+
+void plant_init(plant *p, double position, double load)
+// Initialize an RC servo sized plant at rest at the position with the load.
+{
+    // About 60 degrees in 0.2 seconds with 180 degrees over the pot range.
+    p->position = position;
+    p->velocity = 0.0;
+    p->max_velocity = 1700.0;
+    p->time_constant = 0.025;
+    p->load = load;
+    p->noise = 0.0;
+}
+
+
+int16_t plant_sample(plant *p)
+// Return the ADC position reading of the plant.
+{
+    double reading = p->position;
+
+    // Add uniform noise to the reading.
+    if (p->noise > 0.0) reading += p->noise * (2.0 * rand() / (double) RAND_MAX - 1.0);
+
+    // Quantize to the 10-bit ADC.
+    reading = floor(reading + 0.5);
+    if (reading < 0.0) reading = 0.0;
+    if (reading > 1023.0) reading = 1023.0;
+
+    return (int16_t) reading;
+}
+
+
+void plant_drive(plant *p, int16_t pwm)
+// Drive the plant with the signed PWM output for one sample period.
+{
+    int i;
+    double dt = PLANT_PERIOD / PLANT_STEPS;
+    double duty = (double) pwm / MAX_PWM_OUTPUT;
+
+    for (i = 0; i < PLANT_STEPS; ++i)
+    {
+        // The motor torque less the back-EMF and the load.
+        double target = (duty - p->load) * p->max_velocity;
+
+        p->velocity += (target - p->velocity) * dt / p->time_constant;
+        p->position += p->velocity * dt;
+    }
+}
@@ -0,0 +1,34 @@
+/*
+    Simulated servo plant for the host tests.
+*/
+
+#ifndef _OS_TEST_PLANT_H_
+#define _OS_TEST_PLANT_H_ 1
+
+#include <inttypes.h>
+
+// A DC motor geared to the position pot.  The motor accelerates towards
+// a speed proportional to the PWM duty with a mechanical time constant
+// and is pulled by a constant load such as gravity on an arm.  Positions
+// are in 10-bit ADC units and the plant is stepped once every 10 msec
+// sample period.
+typedef struct plant
+{
+    double position;        // Position in ADC units.
+    double velocity;        // Velocity in ADC units per second.
+    double max_velocity;    // Velocity at full duty in ADC units per second.
+    double time_constant;   // Mechanical time constant in seconds.
+    double load;            // Load as a fraction of the full duty.
+    double noise;           // Peak ADC noise in ADC units.
+} plant;
+
+// Initialize an RC servo sized plant at rest at the position with the load.
+void plant_init(plant *p, double position, double load);
+
+// Return the ADC position reading of the plant.
+int16_t plant_sample(plant *p);
+
+// Drive the plant with the signed PWM output for one sample period.
+void plant_drive(plant *p, int16_t pwm);
+
+#endif // _OS_TEST_PLANT_H_
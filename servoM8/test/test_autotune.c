@@ -0,0 +1,286 @@
+/*
+    Relay feedback autotune test against a simulated servo.
+
+    Checks the Ku/Tu to gain math against hand computed values, runs the
+    relay oscillation of autotune.c on the simulated plant and compares
+    the measured ultimate gain and period with the limit cycle predicted
+    for the plant model.
+    The simulated servo needs more integral gain than the register holds,
+    so the autotune is checked to report the saturated gain.  The tuned
+    gains are then checked to give a stable step response with pid.c and
+    the autotune is checked to abort outside the seek window.
+*/
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "openservo.h"
+#include "config.h"
+#include "autotune.h"
+#include "controller.h"
+#include "pid.h"
+#include "pwm.h"
+#include "registers.h"
+#include "host.h"
+#include "plant.h"
+
+// Seek position the autotune oscillates around.
+#define TEST_SETPOINT           512
+
+// Relative tolerance of the measured ultimate gain and period against the
+// sampled relay model.  The model ignores the harmonics of the relay output
+// and the rounding of the peaks to whole ADC units, which come to about 5%.
+#define TEST_TOLERANCE          0.10
+
+// Sample period of the plant in seconds.
+#define PLANT_PERIOD            0.010
+
+
+static void autotune_setup(void)
+// Reset the registers and the modules with the PID controller selected.
+{
+    host_registers_reset();
+    pid_registers_defaults();
+    autotune_registers_defaults();
+    banks_write_byte(BANK_CONFIG, REG_CONTROLLER_SELECT, CONTROLLER_PID);
+    registers_write_word(REG_SEEK_POSITION_HI, REG_SEEK_POSITION_LO, TEST_SETPOINT);
+    registers_changed();
+
+    pid_init();
+    autotune_init();
+}
+
+
+static int autotune_run(plant *p)
+// Run the autotune on the plant until it finishes and return the samples taken.
+{
+    int samples = 0;
+
+    autotune_start();
+    while (autotune_is_running())
+    {
+        plant_drive(p, autotune_position_to_pwm(plant_sample(p)));
+        ++samples;
+    }
+
+    return samples;
+}
+
+
+static double plant_crossover(const plant *p, double phase)
+// Return the frequency in radians per second at which the phase of the plant
+// model reaches -180 degrees plus the phase.  The plant is an integrator with
+// a first order lag and the relay output is switched at the next sample after
+// a crossing, which adds half a sample of delay on average.  The phase is
+// -90 - atan(w * tau) - w * T / 2 degrees.
+{
+    int i;
+    double lo = 0.0;
+    double hi = M_PI / PLANT_PERIOD;
+    double w = 0.0;
+
+    for (i = 0; i < 100; ++i)
+    {
+        w = (lo + hi) / 2.0;
+        if (atan(w * p->time_constant) + w * PLANT_PERIOD / 2.0 < M_PI / 2.0 - phase) lo = w; else hi = w;
+    }
+
+    return w;
+}
+
+
+static double plant_gain(const plant *p, double w)
+// Return the gain of the plant model from duty to position at the frequency.
+{
+    return p->max_velocity / (w * sqrt(1.0 + w * w * p->time_constant * p->time_constant));
+}
+
+
+static void plant_relay_cycle(const plant *p, double relay, double hysteresis, double *ku, double *tu)
+// Predict the limit cycle of a relay with hysteresis driving the plant model
+// from the describing function of the relay, 4h / (pi * a) lagging by
+// asin(hysteresis / a) for an oscillation of amplitude a.  Returns the
+// ultimate gain the autotune reports as an 8:8 PID gain and the period in
+// samples.  Without hysteresis these are the ultimate gain and period of
+// the plant.
+{
+    int i;
+    double w = plant_crossover(p, 0.0);
+    double h = relay / MAX_PWM_OUTPUT;
+    double a = 4.0 * h * plant_gain(p, w) / M_PI;
+
+    // Iterate the amplitude and frequency of the oscillation.
+    for (i = 0; i < 100; ++i)
+    {
+        w = plant_crossover(p, asin(hysteresis < a ? hysteresis / a : 1.0));
+        a = 4.0 * h * plant_gain(p, w) / M_PI;
+    }
+
+    *ku = 256.0 * 4.0 * relay / (M_PI * a);
+    *tu = 2.0 * M_PI / w / PLANT_PERIOD;
+}
+
+
+static void plant_sampled_relay_cycle(const plant *p, double relay, double hysteresis, double *ku, double *tu)
+// Predict the limit cycle of the relay of the autotune, which works on the
+// position rounded to whole ADC units and switches only at a sample.  The
+// error must pass the hysteresis by a whole unit, so the relay switches half
+// a unit past the hysteresis.  Each half of the cycle then locks to the next
+// whole number of samples and the oscillation grows to the plant gain at
+// that slower frequency.  The uncorrected describing function predicts the
+// ultimate gain about 20% high and the period about 15% short.
+{
+    double w;
+    double a;
+
+    plant_relay_cycle(p, relay, hysteresis + 0.5, ku, tu);
+
+    *tu = 2.0 * ceil(*tu / 2.0);
+    w = 2.0 * M_PI / (*tu * PLANT_PERIOD);
+    a = 4.0 * relay / MAX_PWM_OUTPUT * plant_gain(p, w) / M_PI;
+    *ku = 256.0 * 4.0 * relay / (M_PI * a);
+}
+
+
+static void test_compute_gains(void)
+// Check the gain math against hand computed values.
+{
+    uint16_t ku, kp, kd, ki;
+
+    // Ku = 96 * 652 / 20 = 3129, Kp = 3129 * 3 / 5 = 1877,
+    // Kd = 1877 * 30 / 8 = 7038, Ki = 1877 * 512 / 30 = 32034.
+    CHECK(autotune_compute_gains(96, 20, 30, &ku, &kp, &kd, &ki) == AUTOTUNE_STATUS_DONE);
+    CHECK(ku == 3129);
+    CHECK(kp == 1877);
+    CHECK(kd == 7038);
+    CHECK(ki == 32034);
+
+    // A tiny oscillation saturates the gains rather than wrapping.
+    CHECK(autotune_compute_gains(255, 1, 200, &ku, &kp, &kd, &ki) == AUTOTUNE_STATUS_CLIPPED);
+    CHECK(ku == 0xFFFF);
+    CHECK(kd == 0xFFFF);
+
+    // A short period saturates just the integral gain, Ku = 96 * 652 / 18
+    // = 3477, Kp = 2086, Kd = 2086 * 12 / 8 = 3129, Ki = 2086 * 512 / 12 =
+    // 89002.
+    CHECK(autotune_compute_gains(96, 18, 12, &ku, &kp, &kd, &ki) == AUTOTUNE_STATUS_CLIPPED);
+    CHECK(ku == 3477);
+    CHECK(kp == 2086);
+    CHECK(kd == 3129);
+    CHECK(ki == 0xFFFF);
+
+    // No oscillation can't be used.
+    CHECK(autotune_compute_gains(96, 0, 30, &ku, &kp, &kd, &ki) == AUTOTUNE_STATUS_FAILED);
+    CHECK(autotune_compute_gains(96, 20, 0, &ku, &kp, &kd, &ki) == AUTOTUNE_STATUS_FAILED);
+}
+
+
+static void test_relay(void)
+// Autotune the simulated plant and check the measurement and tuned gains.
+{
+    int i;
+    int samples;
+    plant p;
+    double ideal_ku;
+    double ideal_tu;
+    double model_ku;
+    double model_tu;
+    double ku;
+    double tu;
+    int16_t position = 0;
+    int16_t error;
+    int max_error = 0;
+
+    autotune_setup();
+    plant_init(&p, TEST_SETPOINT, 0.0);
+
+    // The ultimate gain and period of the plant and the relay cycle expected
+    // with the default relay amplitude and hysteresis.
+    plant_relay_cycle(&p, DEFAULT_AUTOTUNE_RELAY << PWM_OUTPUT_SHIFT, 0.0, &ideal_ku, &ideal_tu);
+    plant_sampled_relay_cycle(&p, DEFAULT_AUTOTUNE_RELAY << PWM_OUTPUT_SHIFT, DEFAULT_AUTOTUNE_HYSTERESIS, &model_ku, &model_tu);
+
+    samples = autotune_run(&p);
+
+    ku = banks_read_word(BANK_STATUS, REG_AUTOTUNE_KU_HI, REG_AUTOTUNE_KU_LO);
+    tu = banks_read_word(BANK_STATUS, REG_AUTOTUNE_TU_HI, REG_AUTOTUNE_TU_LO);
+
+    printf("Relay autotune in %d samples\n", samples);
+    printf("  %-20s %10s %10s\n", "", "Ku", "Tu");
+    printf("  %-20s %10.0f %10.1f\n", "plant ultimate", ideal_ku, ideal_tu);
+    printf("  %-20s %10.0f %10.1f\n", "predicted relay", model_ku, model_tu);
+    printf("  %-20s %10.0f %10.1f\n", "measured relay", ku, tu);
+    printf("  PGAIN 0x%04X DGAIN 0x%04X IGAIN 0x%04X\n",
+           registers_read_word(REG_PID_PGAIN_HI, REG_PID_PGAIN_LO),
+           registers_read_word(REG_PID_DGAIN_HI, REG_PID_DGAIN_LO),
+           registers_read_word(REG_PID_IGAIN_HI, REG_PID_IGAIN_LO));
+
+    CHECK(fabs(ku - model_ku) <= TEST_TOLERANCE * model_ku);
+    CHECK(fabs(tu - model_tu) <= TEST_TOLERANCE * model_tu);
+
+    // Ki = 0.6 * Ku * 512 / Tu is more than the 0:16 integral gain holds
+    // for the fast simulated servo, so the autotune reports it saturated.
+    CHECK((0.6 * ku * 512.0 / tu) > 0xFFFF);
+    CHECK(registers_read_word(REG_PID_IGAIN_HI, REG_PID_IGAIN_LO) == 0xFFFF);
+    CHECK(banks_read_byte(BANK_STATUS, REG_AUTOTUNE_STATUS) == AUTOTUNE_STATUS_CLIPPED);
+
+    // Step the seek position with the tuned gains.
+    registers_write_word(REG_SEEK_POSITION_HI, REG_SEEK_POSITION_LO, TEST_SETPOINT + 100);
+    pid_init();
+    for (i = 0; i < 300; ++i)
+    {
+        position = plant_sample(&p);
+        plant_drive(&p, pid_position_to_pwm(position));
+
+        // Track the error over the last second.
+        error = abs(TEST_SETPOINT + 100 - position);
+        if ((i >= 200) && (error > max_error)) max_error = error;
+    }
+
+    printf("  Tuned 100 step error over the last second %d\n", max_error);
+
+    // The tuned servo reaches the new position and stays there.
+    CHECK(max_error <= 2);
+}
+
+
+static void test_abort(void)
+// The autotune aborts with no output when the servo leaves the seek window.
+{
+    plant p;
+
+    autotune_setup();
+    registers_write_word(REG_MIN_SEEK_HI, REG_MIN_SEEK_LO, TEST_SETPOINT - 4);
+    registers_write_word(REG_MAX_SEEK_HI, REG_MAX_SEEK_LO, TEST_SETPOINT + 4);
+    plant_init(&p, TEST_SETPOINT, 0.0);
+
+    autotune_run(&p);
+
+    CHECK(banks_read_byte(BANK_STATUS, REG_AUTOTUNE_STATUS) == AUTOTUNE_STATUS_ABORTED);
+    CHECK(autotune_position_to_pwm(TEST_SETPOINT + 10) == 0);
+}
+
+
+static void test_controller(void)
+// The autotune refuses to tune controllers other than PID.
+{
+    autotune_setup();
+    banks_write_byte(BANK_CONFIG, REG_CONTROLLER_SELECT, CONTROLLER_IPD);
+
+    autotune_start();
+
+    CHECK(!autotune_is_running());
+    CHECK(banks_read_byte(BANK_STATUS, REG_AUTOTUNE_STATUS) == AUTOTUNE_STATUS_FAILED);
+}
+
+
+int main(void)
+{
+    test_compute_gains();
+    test_relay();
+    test_abort();
+    test_controller();
+
+    return host_result();
+}
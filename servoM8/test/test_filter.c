@@ -0,0 +1,315 @@
+/*
+    Lag versus noise attenuation benchmark of the configurable filters.
+
+    Runs each filter type of filter.c over a position trace and reports the
+    lag the filter adds and how much of the ADC noise it passes.  The trace
+    is a simulated servo moving under an open loop drive with ADC noise, or
+    a recorded trace given on the command line as a text file with one
+    decoded FIFO record per line:
+
+        <tick> <position> <power>
+
+    Lines starting with '#' are skipped.  A recorded trace has no noise free
+    reference, so the reference is the zero phase centered average of the
+    trace over TRACE_REFERENCE samples.
+
+    The lag is the delay of the reference that best matches the filter
+    output and the error is the RMS difference between the two in ADC
+    units, which includes both the noise passed and the distortion of the
+    motion.  The noise ratio is the RMS noise of the output over that of
+    the input, with the noise of the output taken as the difference between
+    filtering the trace and filtering the reference, so 1.00 passes all of
+    the noise.
+*/
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "openservo.h"
+#include "config.h"
+#include "filter.h"
+#include "pwm.h"
+#include "host.h"
+#include "plant.h"
+
+// Samples in the simulated trace and the largest trace read.
+#define TRACE_SAMPLES           2000
+#define TRACE_MAX               20000
+
+// Peak ADC noise of the simulated trace in ADC units.
+#define TRACE_NOISE             3.0
+
+// Centered average window for the reference of a recorded trace.
+#define TRACE_REFERENCE         9
+
+// Largest lag searched and the search step in samples.
+#define LAG_MAX                 20.0
+#define LAG_STEP                0.05
+
+// Samples at the start of the trace skipped while the filter settles.
+#define SETTLE_SAMPLES          50
+
+typedef struct trace
+{
+    int count;
+    int16_t input[TRACE_MAX];
+    double reference[TRACE_MAX];
+} trace;
+
+typedef struct filter_config
+{
+    const char *name;
+    uint8_t type;
+    uint8_t coefficient;
+} filter_config;
+
+typedef struct filter_result
+{
+    double lag;
+    double error;
+    double noise;
+} filter_result;
+
+static const filter_config configs[] =
+{
+    { "none",               FILTER_TYPE_NONE,       0x00 },
+    { "IIR1 0xC0",          FILTER_TYPE_IIR1,       0xC0 },
+    { "IIR1 0x80 default",  FILTER_TYPE_IIR1,       0x80 },
+    { "IIR1 0x40",          FILTER_TYPE_IIR1,       0x40 },
+    { "IIR1 0x20",          FILTER_TYPE_IIR1,       0x20 },
+    { "IIR2 0xC0",          FILTER_TYPE_IIR2,       0xC0 },
+    { "IIR2 0x80",          FILTER_TYPE_IIR2,       0x80 },
+    { "IIR2 0x40",          FILTER_TYPE_IIR2,       0x40 },
+    { "average 2",          FILTER_TYPE_AVERAGE,    0x01 },
+    { "average 4",          FILTER_TYPE_AVERAGE,    0x02 },
+    { "average 8",          FILTER_TYPE_AVERAGE,    0x03 },
+};
+
+#define CONFIG_COUNT            (sizeof(configs) / sizeof(configs[0]))
+
+static trace samples;
+
+
+static void trace_simulate(trace *t)
+// Record the simulated servo swept back and forth by an open loop drive.
+{
+    int i;
+    plant p;
+
+    srand(1);
+    plant_init(&p, 512.0, 0.0);
+    p.noise = TRACE_NOISE;
+
+    for (i = 0; i < TRACE_SAMPLES; ++i)
+    {
+        // Sweep the drive at 0.5 and 1.3 Hz for a mix of slow and fast moves.
+        double duty = 0.25 * sin(2.0 * M_PI * 0.5 * i / 100.0) + 0.10 * sin(2.0 * M_PI * 1.3 * i / 100.0);
+
+        t->reference[i] = p.position;
+        t->input[i] = plant_sample(&p);
+        plant_drive(&p, (int16_t) (duty * MAX_PWM_OUTPUT));
+    }
+
+    t->count = TRACE_SAMPLES;
+}
+
+
+static int trace_read(trace *t, const char *path)
+// Read a recorded trace and compute its reference.
+{
+    int i, j;
+    char line[128];
+    long tick, position, power;
+    FILE *file = fopen(path, "r");
+
+    if (!file)
+    {
+        perror(path);
+        return 0;
+    }
+
+    t->count = 0;
+    while (fgets(line, sizeof(line), file) && (t->count < TRACE_MAX))
+    {
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%ld %ld %ld", &tick, &position, &power) < 2) continue;
+        t->input[t->count++] = (int16_t) position;
+    }
+
+    fclose(file);
+
+    // Centered average of the trace, shortened at the ends.
+    for (i = 0; i < t->count; ++i)
+    {
+        int n = 0;
+        double sum = 0.0;
+
+        for (j = i - TRACE_REFERENCE / 2; j <= i + TRACE_REFERENCE / 2; ++j)
+        {
+            if ((j < 0) || (j >= t->count)) continue;
+            sum += t->input[j];
+            ++n;
+        }
+
+        t->reference[i] = sum / n;
+    }
+
+    return t->count > 2 * (SETTLE_SAMPLES + (int) LAG_MAX);
+}
+
+
+static double trace_delayed(const trace *t, int i, double lag)
+// Return the reference delayed by the fractional lag.
+{
+    double at = i - lag;
+    int n = (int) floor(at);
+    double f = at - n;
+
+    return t->reference[n] * (1.0 - f) + t->reference[n + 1] * f;
+}
+
+
+static void filter_run(const filter_config *c, const int16_t *input, int16_t *output, int count)
+// Filter the input from rest at its first sample.
+{
+    int i;
+    filter_state filter;
+
+    filter_state_reset(&filter, c->type, c->coefficient, input[0]);
+    for (i = 0; i < count; ++i) output[i] = filter_state_update(&filter, c->type, c->coefficient, input[i]);
+}
+
+
+static filter_result filter_measure(const trace *t, const filter_config *c)
+// Filter the trace and measure the lag and the noise passed.
+{
+    int i;
+    int start = SETTLE_SAMPLES + (int) LAG_MAX + 1;
+    double lag;
+    double noise_in = 0.0;
+    double noise_out = 0.0;
+    filter_result result = { 0.0, -1.0, 0.0 };
+    static int16_t output[TRACE_MAX];
+    static int16_t clean[TRACE_MAX];
+    static int16_t clean_output[TRACE_MAX];
+
+    // Filter the trace and the reference quantized as the ADC would.
+    for (i = 0; i < t->count; ++i) clean[i] = (int16_t) floor(t->reference[i] + 0.5);
+    filter_run(c, t->input, output, t->count);
+    filter_run(c, clean, clean_output, t->count);
+
+    // RMS noise of the input and the output.
+    for (i = start; i < t->count; ++i)
+    {
+        noise_in += (double) (t->input[i] - clean[i]) * (t->input[i] - clean[i]);
+        noise_out += (double) (output[i] - clean_output[i]) * (output[i] - clean_output[i]);
+    }
+    result.noise = sqrt(noise_out / noise_in);
+
+    // Find the delay of the reference closest to the output.
+    for (lag = 0.0; lag <= LAG_MAX; lag += LAG_STEP)
+    {
+        double error = 0.0;
+
+        for (i = start; i < t->count; ++i)
+        {
+            double d = output[i] - trace_delayed(t, i, lag);
+            error += d * d;
+        }
+
+        error = sqrt(error / (t->count - start));
+        if ((result.error < 0.0) || (error < result.error))
+        {
+            result.error = error;
+            result.lag = lag;
+        }
+    }
+
+    return result;
+}
+
+
+static void test_oversampled(void)
+// Check each filter settles at and stays within the range of positions
+// oversampled by the largest ADC_OVERSAMPLE_BITS.
+{
+    unsigned int i;
+    int j;
+    int16_t output = 0;
+    int16_t maximum = (1023 << 3) + 7;
+    filter_state filter;
+
+    for (i = 0; i < CONFIG_COUNT; ++i)
+    {
+        // Step from the bottom to the top of the range.
+        filter_state_reset(&filter, configs[i].type, configs[i].coefficient, 0);
+        for (j = 0; j < 100; ++j)
+        {
+            output = filter_state_update(&filter, configs[i].type, configs[i].coefficient, maximum);
+            CHECK((output >= 0) && (output <= maximum));
+        }
+        CHECK(output >= maximum - 1);
+
+        // Start at the top of the range.
+        filter_state_reset(&filter, configs[i].type, configs[i].coefficient, maximum);
+        output = filter_state_update(&filter, configs[i].type, configs[i].coefficient, maximum);
+        CHECK(output == maximum);
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    unsigned int i;
+    filter_result results[CONFIG_COUNT];
+
+    if (argc > 1)
+    {
+        if (!trace_read(&samples, argv[1])) return 1;
+        printf("Filters on %s, %d samples\n", argv[1], samples.count);
+    }
+    else
+    {
+        trace_simulate(&samples);
+        printf("Filters on a simulated trace with +/-%.0f ADC noise, %d samples\n", TRACE_NOISE, samples.count);
+    }
+
+    printf("  %-20s %10s %10s %10s\n", "", "lag", "error", "noise");
+    for (i = 0; i < CONFIG_COUNT; ++i)
+    {
+        results[i] = filter_measure(&samples, &configs[i]);
+        printf("  %-20s %7.1f ms %10.2f %10.2f\n", configs[i].name,
+               results[i].lag * 10.0, results[i].error, results[i].noise);
+    }
+
+    // The checks only hold for the known noise of the simulated trace.
+    if (argc > 1) return 0;
+
+    test_oversampled();
+
+    // No filtering adds no lag and passes all the noise.
+    CHECK(results[0].lag == 0.0);
+    CHECK(fabs(results[0].noise - 1.0) < 0.05);
+
+    // The default filter trades about a sample of lag for cutting the
+    // noise to below 70% and tracks the motion better than no filter.
+    CHECK(results[2].lag <= 1.5);
+    CHECK(results[2].noise < 0.7);
+    CHECK(results[2].error < results[0].error);
+
+    // Smaller IIR coefficients filter more at the cost of more lag.
+    for (i = 1; i < 4; ++i)
+    {
+        CHECK(results[i + 1].lag > results[i].lag);
+        CHECK(results[i + 1].noise < results[i].noise);
+    }
+
+    // The moving average of 2^n samples lags by (2^n - 1) / 2 samples.
+    CHECK(fabs(results[8].lag - 0.5) <= 0.25);
+    CHECK(fabs(results[9].lag - 1.5) <= 0.25);
+    CHECK(fabs(results[10].lag - 3.5) <= 0.25);
+
+    return host_result();
+}
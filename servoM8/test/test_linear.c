@@ -0,0 +1,226 @@
+/*
+    Position linearization calibration test.
+
+    Records reference points the way the TWI_CMD_LINEAR_XXX commands do and
+    checks the table filled by linear_calibrate_finish against corrections
+    interpolated between the references, held past the first and last
+    references and clamped to the range of a table point.  The filled table
+    is then checked to correct every raw position by interpolating between
+    the table points.
+*/
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "openservo.h"
+#include "config.h"
+#include "linear.h"
+#include "registers.h"
+#include "host.h"
+
+// The maximum servo position as defined by 10-bit ADC values.
+#define MAX_POSITION            1023
+
+typedef struct reference
+{
+    uint16_t raw;
+    uint16_t position;
+} reference;
+
+
+static void linear_setup(void)
+// Reset the registers and the linearization module.
+{
+    host_registers_reset();
+    linear_registers_defaults();
+    linear_init();
+}
+
+
+static void calibrate(const reference *references, int count)
+// Record the references and fill the table.
+{
+    int i;
+
+    linear_calibrate_start();
+    for (i = 0; i < count; ++i)
+    {
+        // The servo reads the raw position and the host writes the reference.
+        linear_correct(references[i].raw, 0);
+        banks_write_word(BANK_LINEAR, REG_LINEAR_REFERENCE_HI, REG_LINEAR_REFERENCE_LO, references[i].position);
+        linear_calibrate_point();
+    }
+    linear_calibrate_finish();
+}
+
+
+static double expected_correction(const reference *references, int count, int raw)
+// Return the correction at the raw position interpolated between the sorted
+// references and held past the ends.
+{
+    int i;
+
+    if (raw <= references[0].raw) return (double) references[0].position - references[0].raw;
+    if (raw >= references[count - 1].raw) return (double) references[count - 1].position - references[count - 1].raw;
+
+    for (i = 0; references[i + 1].raw < raw; ++i);
+
+    return ((double) references[i].position - references[i].raw) +
+           (((double) references[i + 1].position - references[i + 1].raw) -
+            ((double) references[i].position - references[i].raw)) *
+           (raw - references[i].raw) / (references[i + 1].raw - references[i].raw);
+}
+
+
+static void check_table(const reference *sorted, int count)
+// Check the table points and the correction of the references.
+{
+    int i;
+
+    CHECK(banks_read_byte(BANK_LINEAR, REG_LINEAR_ENABLE) == 1);
+    CHECK(banks_read_byte(BANK_STATUS, REG_LINEAR_STATUS) == count);
+
+    // Each table point is the interpolated correction truncated to a count.
+    for (i = 0; i < LINEAR_POINTS; ++i)
+    {
+        double expected = expected_correction(sorted, count, i << LINEAR_POINT_SHIFT);
+        int8_t point = (int8_t) banks_read_byte(BANK_LINEAR, REG_LINEAR_POINT_0 + i);
+
+        if (fabs(point - expected) >= 1.0) printf("  point %d is %d, expected %.2f\n", i, point, expected);
+        CHECK(fabs(point - expected) < 1.0);
+    }
+
+    // Every raw position reads as interpolated between the expected table
+    // points, within the truncation of the points and of the correction.
+    for (i = 0; i <= MAX_POSITION; ++i)
+    {
+        int index = i >> LINEAR_POINT_SHIFT;
+        double fraction = (double) (i & ((1 << LINEAR_POINT_SHIFT) - 1)) / (1 << LINEAR_POINT_SHIFT);
+        double expected = i + expected_correction(sorted, count, index << LINEAR_POINT_SHIFT) * (1.0 - fraction) +
+                              expected_correction(sorted, count, (index + 1) << LINEAR_POINT_SHIFT) * fraction;
+
+        if (expected < 0.0) expected = 0.0;
+        if (expected > MAX_POSITION) expected = MAX_POSITION;
+
+        CHECK(fabs(linear_correct(i, 0) - expected) < 2.0);
+        CHECK(fabs(linear_correct(i << 3, 3) - expected * 8.0) < 16.0);
+    }
+}
+
+
+static void check_references(const reference *references, int count)
+// Check the raw position of each reference reads as the reference.
+{
+    int i;
+
+    for (i = 0; i < count; ++i)
+    {
+        CHECK(linear_correct(references[i].raw, 0) == references[i].position);
+        CHECK(linear_correct(references[i].raw << 3, 3) == (references[i].position << 3));
+    }
+}
+
+
+static void test_interpolation(void)
+// A pot reading a few percent short near the ends of its travel.
+{
+    static const reference references[] =
+    {
+        { 40, 20 }, { 150, 140 }, { 300, 296 }, { 512, 512 },
+        { 700, 704 }, { 880, 892 }, { 990, 1012 },
+    };
+    static const reference shuffled[] =
+    {
+        { 512, 512 }, { 990, 1012 }, { 40, 20 }, { 700, 704 },
+        { 150, 140 }, { 880, 892 }, { 300, 296 },
+    };
+    int count = sizeof(references) / sizeof(references[0]);
+
+    // References recorded in order.
+    linear_setup();
+    calibrate(references, count);
+    check_table(references, count);
+
+    // References recorded out of order are sorted by raw position.
+    linear_setup();
+    calibrate(shuffled, count);
+    check_table(references, count);
+
+    // Points below the first and above the last reference hold the end
+    // corrections rather than extrapolating them.
+    CHECK((int8_t) banks_read_byte(BANK_LINEAR, REG_LINEAR_POINT_0) == -20);
+    CHECK((int8_t) banks_read_byte(BANK_LINEAR, REG_LINEAR_POINT_0 + LINEAR_POINTS - 1) == 22);
+    CHECK(linear_correct(0, 0) == 0);
+    CHECK(linear_correct(1023, 0) == 1023);
+}
+
+
+static void test_table_points(void)
+// References on the table points are reproduced exactly.
+{
+    static const reference references[] =
+    {
+        { 64, 50 }, { 256, 250 }, { 512, 512 }, { 768, 775 }, { 960, 980 },
+    };
+    int count = sizeof(references) / sizeof(references[0]);
+
+    linear_setup();
+    calibrate(references, count);
+    check_table(references, count);
+    check_references(references, count);
+}
+
+
+static void test_clamp(void)
+// Corrections too large for a table point are clamped.
+{
+    static const reference references[] =
+    {
+        { 100, 300 }, { 900, 600 },
+    };
+
+    linear_setup();
+    calibrate(references, 2);
+
+    CHECK((int8_t) banks_read_byte(BANK_LINEAR, REG_LINEAR_POINT_0) == 127);
+    CHECK((int8_t) banks_read_byte(BANK_LINEAR, REG_LINEAR_POINT_0 + LINEAR_POINTS - 1) == -127);
+}
+
+
+static void test_failed(void)
+// A calibration without two distinct references fails and leaves the table
+// disabled.
+{
+    static const reference single[] =
+    {
+        { 512, 500 },
+    };
+    static const reference same[] =
+    {
+        { 512, 500 }, { 512, 520 },
+    };
+
+    linear_setup();
+    calibrate(single, 1);
+    CHECK(banks_read_byte(BANK_STATUS, REG_LINEAR_STATUS) == LINEAR_STATUS_FAILED);
+    CHECK(banks_read_byte(BANK_LINEAR, REG_LINEAR_ENABLE) == 0);
+    CHECK(linear_correct(512, 0) == 512);
+
+    linear_setup();
+    calibrate(same, 2);
+    CHECK(banks_read_byte(BANK_STATUS, REG_LINEAR_STATUS) == LINEAR_STATUS_FAILED);
+    CHECK(banks_read_byte(BANK_LINEAR, REG_LINEAR_ENABLE) == 0);
+}
+
+
+int main(void)
+{
+    test_interpolation();
+    test_table_points();
+    test_clamp();
+    test_failed();
+
+    return host_result();
+}
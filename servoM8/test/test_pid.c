@@ -0,0 +1,159 @@
+/*
+    Step response benchmark of the PID algorithm integral term.
+
+    Runs pid.c against a simulated servo holding a gravity load and reports
+    the steady state error, settling time and overshoot of a step without
+    the integral term (IGAIN zero, which gives the same output as before the
+    integral term existed) and with it.  Fails if the integral term doesn't
+    remove the steady state error or winds up on a long saturated move.
+*/
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include "openservo.h"
+#include "config.h"
+#include "pid.h"
+#include "registers.h"
+#include "host.h"
+#include "plant.h"
+
+// Gains of the known servo hardware types.
+#define TEST_PGAIN              0x0600
+#define TEST_DGAIN              0x1800
+#define TEST_IGAIN              0x2000
+
+// Load on the servo as a fraction of the full duty.
+#define TEST_LOAD               0.08
+
+// Samples run after the step and the samples at the end averaged for the
+// steady state error.
+#define STEP_SAMPLES            400
+#define STEADY_SAMPLES          100
+
+// Error within which the servo is considered settled.
+#define SETTLE_BAND             2
+
+typedef struct step_result
+{
+    double steady_error;
+    int settling_time;
+    int overshoot;
+} step_result;
+
+
+static void pid_setup(uint16_t i_gain)
+// Reset the registers and the PID algorithm with the test gains.
+{
+    host_registers_reset();
+    pid_registers_defaults();
+
+    registers_write_byte(REG_PID_DEADBAND, 0x01);
+    registers_write_word(REG_PID_PGAIN_HI, REG_PID_PGAIN_LO, TEST_PGAIN);
+    registers_write_word(REG_PID_DGAIN_HI, REG_PID_DGAIN_LO, TEST_DGAIN);
+    registers_write_word(REG_PID_IGAIN_HI, REG_PID_IGAIN_LO, i_gain);
+    registers_write_word(REG_MIN_SEEK_HI, REG_MIN_SEEK_LO, 0x0000);
+    registers_write_word(REG_MAX_SEEK_HI, REG_MAX_SEEK_LO, 0x03FF);
+    registers_changed();
+
+    pid_init();
+}
+
+
+static int16_t pid_sample(plant *p)
+// Run one sample period of the PID algorithm and the plant.
+{
+    int16_t position = plant_sample(p);
+
+    plant_drive(p, pid_position_to_pwm(position));
+
+    return position;
+}
+
+
+static step_result step_response(uint16_t i_gain, int16_t from, int16_t to)
+// Hold the servo at the from position under load, step the seek position
+// to the to position and measure the response.
+{
+    int i;
+    plant p;
+    step_result result = { 0.0, -1, 0 };
+    int16_t direction = (to > from) ? 1 : -1;
+
+    pid_setup(i_gain);
+    plant_init(&p, from, TEST_LOAD);
+
+    // Settle at the start position.
+    registers_write_word(REG_SEEK_POSITION_HI, REG_SEEK_POSITION_LO, (uint16_t) from);
+    for (i = 0; i < STEP_SAMPLES; ++i) pid_sample(&p);
+
+    // Step to the new position.
+    registers_write_word(REG_SEEK_POSITION_HI, REG_SEEK_POSITION_LO, (uint16_t) to);
+    for (i = 0; i < STEP_SAMPLES; ++i)
+    {
+        int16_t position = pid_sample(&p);
+        int16_t error = to - position;
+
+        // The servo has settled from the last sample it was outside the band.
+        if ((error > SETTLE_BAND) || (error < -SETTLE_BAND)) result.settling_time = -1;
+        else if (result.settling_time < 0) result.settling_time = i;
+
+        // Track the overshoot past the seek position.
+        if (-error * direction > result.overshoot) result.overshoot = -error * direction;
+
+        // Average the error at the end.
+        if (i >= (STEP_SAMPLES - STEADY_SAMPLES)) result.steady_error += (double) abs(error) / STEADY_SAMPLES;
+    }
+
+    return result;
+}
+
+
+static void report(const char *name, step_result r)
+// Print a line of the benchmark.
+{
+    if (r.settling_time < 0)
+        printf("  %-22s %8.2f %13s %10d\n", name, r.steady_error, "never", r.overshoot);
+    else
+        printf("  %-22s %8.2f %10d ms %10d\n", name, r.steady_error, r.settling_time * 10, r.overshoot);
+}
+
+
+int main(void)
+{
+    step_result before;
+    step_result after;
+    step_result long_before;
+    step_result long_after;
+
+    printf("PID step response with a %.0f%% gravity load\n", TEST_LOAD * 100.0);
+    printf("  %-22s %8s %13s %10s\n", "", "error", "settling", "overshoot");
+
+    // A short step where the load dominates the steady state error.
+    before = step_response(0x0000, 400, 450);
+    after = step_response(TEST_IGAIN, 400, 450);
+    report("50 step, IGAIN 0", before);
+    report("50 step, IGAIN 0x2000", after);
+
+    // A long step that saturates the output for many samples.
+    long_before = step_response(0x0000, 200, 800);
+    long_after = step_response(TEST_IGAIN, 200, 800);
+    report("600 step, IGAIN 0", long_before);
+    report("600 step, IGAIN 0x2000", long_after);
+
+    // Without the integral term the load holds the servo several counts off.
+    CHECK(before.steady_error >= 2.0);
+
+    // The integral term removes the steady state error and settles.
+    CHECK(after.steady_error <= 1.0);
+    CHECK(after.settling_time >= 0);
+
+    // The anti-windup keeps the integral from growing while the output is
+    // saturated so the long move overshoots by no more than 2% of the step.
+    CHECK(long_after.steady_error <= 1.0);
+    CHECK(long_after.settling_time >= 0);
+    CHECK(long_after.overshoot <= 12);
+
+    return host_result();
+}
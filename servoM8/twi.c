@@ -32,6 +32,7 @@
 #include "config.h"
 #include "registers.h"
 #include "twi.h"
+#include "fifo.h"
 
 //////////////////////////////////////////////////////////////////
 ///////////////// Driver Buffer Definitions //////////////////////
@@ -95,6 +96,7 @@ static uint8_t twi_slave_address;
 #endif
 
 static volatile uint8_t twi_address;
+static volatile uint8_t twi_bank;
 static volatile uint8_t twi_data_state;
 static volatile uint8_t twi_overflow_state;
 
@@ -127,10 +129,33 @@ static uint8_t twi_registers_read(uint8_t address)
     // Are we reading an unused register.
     if (address <= MAX_UNUSED_REGISTER)
     {
+#if FIFO_ENABLED
+        // Are we reading the sample FIFO registers?
+        if (address == REG_FIFO_STATUS) return fifo_read_status();
+        if (address == REG_FIFO_DATA) return fifo_read_byte();
+#endif
+
         // Block the read.
         return 0;
     }
 
+    // Are we reading the bank select register?
+    if (address == REG_BANK_SELECT)
+    {
+        // Yes. Return the selected bank.
+        return twi_bank;
+    }
+
+    // Are we reading a bank register?
+    if (address <= MAX_BANK_REGISTER)
+    {
+        // Block the read if a bank not present is selected.
+        if (!banks_is_present(twi_bank)) return 0;
+
+        // Complete the read from the selected bank.
+        return banks_read_byte(twi_bank, address);
+    }
+
     // Are we reading a redirect register.
     if (address <= MAX_REDIRECT_REGISTER)
     {
@@ -184,6 +209,15 @@ static void twi_registers_write(uint8_t address, uint8_t data)
         return;
     }
 
+    // Are we writing the bank select register?
+    if (address == REG_BANK_SELECT)
+    {
+        // Yes. Select the bank.
+        twi_bank = data;
+
+        return;
+    }
+
     // Is writing to the upper registers disabled?
     if (registers_is_write_disabled())
     {
@@ -191,6 +225,9 @@ static void twi_registers_write(uint8_t address, uint8_t data)
         return;
     }
 
+    // Let modules caching the upper registers know they may have changed.
+    registers_changed();
+
     // Are we writing a write protected register?
     if (address <= MAX_WRITE_PROTECT_REGISTER)
     {
@@ -207,6 +244,18 @@ static void twi_registers_write(uint8_t address, uint8_t data)
         return;
     }
 
+    // Are we writing a bank register?
+    if (address <= MAX_BANK_REGISTER)
+    {
+        // Complete the write if a write protected bank present is selected.
+        if ((twi_bank != BANK_STATUS) && banks_is_present(twi_bank))
+        {
+            banks_write_byte(twi_bank, address, data);
+        }
+
+        return;
+    }
+
 
     // Are we writing a redirect register.
     if (address <= MAX_REDIRECT_REGISTER)
@@ -258,11 +307,23 @@ static void twi_write_buffer(void)
 #endif
 
 
+static inline void twi_next_read_address(void)
+// Advance the address after a read.
+{
+#if FIFO_ENABLED
+    // Stay on the sample FIFO data register so bulk reads drain the FIFO.
+    if ((twi_address & 0x7F) == REG_FIFO_DATA) return;
+#endif
+
+    // Increment the address.
+    ++twi_address;
+}
+
+
 static uint8_t twi_read_data()
 // Handle checked/non-checked read of data.
 {
-    // By default read the data to be returned.
-    uint8_t data = twi_registers_read(twi_address);
+    uint8_t data;
 
 #if TWI_CHECKED_ENABLED
     // Are we handling checked data?
@@ -271,6 +332,9 @@ static uint8_t twi_read_data()
         // Have we reached the end of the read?
         if (twi_chk_count < twi_chk_count_target)
         {
+            // Read the data to be returned.
+            data = twi_registers_read(twi_address);
+
             // Add the data to the check sum.
             twi_chk_sum += data;
 
@@ -278,22 +342,29 @@ static uint8_t twi_read_data()
             ++twi_chk_count;
 
             // Increment the address.
-            ++twi_address;
+            twi_next_read_address();
         }
         else
         {
-            // Replace the data with the checksum.
+            // Return the checksum without reading a register so no
+            // sample FIFO data is lost.
             data = twi_chk_sum;
         }
     }
     else
     {
+        // Read the data to be returned.
+        data = twi_registers_read(twi_address);
+
         // Increment the address.
-        ++twi_address;
+        twi_next_read_address();
     }
 #else
+    // Read the data to be returned.
+    data = twi_registers_read(twi_address);
+
     // Increment the address.
-    ++twi_address;
+    twi_next_read_address();
 #endif
 
     return data;
@@ -416,6 +487,9 @@ twi_slave_init(uint8_t slave_address)
     twi_rxtail = 0;
     twi_rxhead = 0;
 
+    // Select the first register bank.
+    twi_bank = BANK_STATUS;
+
 #if defined(__AVR_ATtiny45__) || defined(__AVR_ATtiny85__)
     // Set the slave address.
     twi_slave_address = slave_address & 0x7f;
@@ -42,6 +42,12 @@
 #define TWI_CMD_CURVE_MOTION_DISABLE    0x92        // Disable curve motion processing.
 #define TWI_CMD_CURVE_MOTION_RESET      0x93        // Reset the curve motion buffer.
 #define TWI_CMD_CURVE_MOTION_APPEND     0x94        // Append curve motion data.
+#define TWI_CMD_AUTOTUNE                0x95        // Start a relay feedback autotune of the PID gains.
+#define TWI_CMD_LINEAR_START            0x96        // Start a position linearization calibration.
+#define TWI_CMD_LINEAR_POINT            0x97        // Record a position linearization reference point.
+#define TWI_CMD_LINEAR_FINISH           0x98        // Fill the position linearization table.
+#define TWI_CMD_FIFO_RESET              0x99        // Empty the ADC sample FIFO.
+#define TWI_CMD_HEALTH_RESET            0x9A        // Reset the ADC pipeline health counters.
 
 
 #if defined(__AVR_ATmega8__) || defined(__AVR_ATmega88__)|| defined(__AVR_ATmega168__)
@@ -0,0 +1,160 @@
+/*
+    Copyright (c) 2006 Michael P. Thompson <mpthompson@gmail.com>
+
+    Permission is hereby granted, free of charge, to any person 
+    obtaining a copy of this software and associated documentation 
+    files (the "Software"), to deal in the Software without 
+    restriction, including without limitation the rights to use, copy, 
+    modify, merge, publish, distribute, sublicense, and/or sell copies 
+    of the Software, and to permit persons to whom the Software is 
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be 
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+
+    $Id$
+*/
+
+#include <inttypes.h>
+
+#include "openservo.h"
+#include "config.h"
+#include "adc.h"
+#include "pwm.h"
+#include "voltage.h"
+#include "registers.h"
+
+// Compile following for supply voltage compensation.
+#if VOLTAGE_COMP_ENABLED
+
+//
+// Supply Voltage Compensation
+//
+// The torque produced by a PWM duty is proportional to the supply voltage
+// so the loop gain drifts as a battery discharges.  This stage sits just
+// before pwm_update and scales the PWM by REG_VOLTAGE_NOMINAL / REG_VOLTAGE
+// so a PWM value gives the same average motor voltage at any charge.
+//
+// The supply voltage is sampled every VOLTAGE_COMP_PERIOD sample periods.
+// The ratio is kept as a reciprocal gain with 8 fractional bits which is
+// only recomputed when the measured or nominal voltage changes so no
+// division is done in the common case.  The gain is limited to between
+// 1/2 and 2.  Setting REG_VOLTAGE_NOMINAL to zero disables the
+// compensation.  Both voltages are in ADC units of the voltage input.
+// The nominal voltage is only read from the registers when the register
+// write count shows they have changed.
+//
+
+// The maximum output.
+#define MAX_OUTPUT              (MAX_PWM_OUTPUT)
+
+// Limits of the compensation gain with 8 fractional bits.
+#define MIN_GAIN                (128)
+#define MAX_GAIN                (512)
+
+// Values preserved across multiple iterations.
+static uint8_t voltage_countdown;
+static uint8_t voltage_write_count;
+static uint16_t voltage_measured;
+static uint16_t voltage_nominal;
+static uint16_t voltage_gain;
+
+
+void voltage_init(void)
+// Initialize the supply voltage compensation module.
+{
+    // Sample the supply voltage in the first sample period.
+    voltage_countdown = 1;
+
+    // Start with a gain of one.
+    voltage_measured = 0;
+    voltage_nominal = 0;
+    voltage_gain = 256;
+
+    // Force the nominal voltage to be refreshed.
+    voltage_write_count = registers_get_write_count() - 1;
+}
+
+
+void voltage_registers_defaults(void)
+// Initialize the supply voltage compensation related register values.
+{
+    banks_write_word(BANK_CONFIG, REG_VOLTAGE_NOMINAL_HI, REG_VOLTAGE_NOMINAL_LO, DEFAULT_VOLTAGE_NOMINAL);
+}
+
+
+int16_t voltage_compensate(int16_t pwm)
+// Take the signed PWM output as input and output the PWM scaled by the
+// ratio of the nominal to the measured supply voltage.
+{
+    uint8_t changed = 0;
+    uint16_t measured;
+    uint16_t nominal;
+    int32_t output;
+
+    // Periodically request a new supply voltage sample.
+    if (--voltage_countdown == 0)
+    {
+        voltage_countdown = VOLTAGE_COMP_PERIOD;
+        adc_read_voltage();
+    }
+
+    // Refresh the nominal supply voltage if the registers have changed.
+    if (voltage_write_count != registers_get_write_count())
+    {
+        // Remember the count before reading so that a write during the
+        // refresh causes another refresh.
+        voltage_write_count = registers_get_write_count();
+
+        nominal = banks_read_word(BANK_CONFIG, REG_VOLTAGE_NOMINAL_HI, REG_VOLTAGE_NOMINAL_LO);
+        if (nominal != voltage_nominal)
+        {
+            voltage_nominal = nominal;
+            changed = 1;
+        }
+    }
+
+    // Get the measured supply voltage.
+    measured = registers_read_word(REG_VOLTAGE_HI, REG_VOLTAGE_LO);
+
+    // Recompute the gain only when either voltage changes.
+    if (changed || (measured != voltage_measured))
+    {
+        voltage_measured = measured;
+        nominal = voltage_nominal;
+
+        if ((nominal == 0) || (measured == 0))
+        {
+            // Compensation is disabled or the voltage is not yet known.
+            voltage_gain = 256;
+        }
+        else
+        {
+            // Determine the gain limiting it to a sensible range.
+            uint32_t gain = ((uint32_t) nominal << 8) / measured;
+            if (gain < MIN_GAIN) gain = MIN_GAIN;
+            if (gain > MAX_GAIN) gain = MAX_GAIN;
+            voltage_gain = (uint16_t) gain;
+        }
+    }
+
+    // Scale the PWM by the gain.
+    output = ((int32_t) pwm * (int32_t) voltage_gain) >> 8;
+
+    // Limit the output.
+    if (output > MAX_OUTPUT) output = MAX_OUTPUT;
+    if (output < -MAX_OUTPUT) output = -MAX_OUTPUT;
+
+    return (int16_t) output;
+}
+
+#endif // VOLTAGE_COMP_ENABLED